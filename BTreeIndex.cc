@@ -11,6 +11,7 @@
 #include "BTreeNode.h"
 #include <cstring>
 #include <cstdlib>
+#include <climits>
 #include <iostream>
 
 using namespace std;
@@ -22,7 +23,8 @@ BTreeIndex::BTreeIndex()
 {
     rootPid = -1;
     treeHeight = 0;
-    std::fill(index_buffer, index_buffer + PageFile::PAGE_SIZE, -1); // empty out buffer
+    mapPid = -1;
+    std::fill(index_buffer, index_buffer + sizeof(index_buffer), -1); // empty out buffer
 }
 
 /*
@@ -45,6 +47,13 @@ RC BTreeIndex::open(const string& indexname, char mode)
 	if(pf.endPid() <= 0) {
 	    rc = pf.write(0, index_buffer);
 		if (rc < 0) {
+			pf.close();
+			return rc;
+		}
+
+		// a new file places its nodes through a free-space map
+		if ((rc = alloc.create(pf, mapPid)) < 0 || (rc = storeRoot()) < 0) {
+			pf.close();
 			return rc;
 		}
 	} else {
@@ -53,9 +62,10 @@ RC BTreeIndex::open(const string& indexname, char mode)
 			return rc;
 		}
 
-		int t_pid = -1, t_height = 0;
+		int t_pid = -1, t_height = 0, t_map = -1;
 		memcpy(&t_pid, index_buffer, intSize);
 		memcpy(&t_height, index_buffer + intSize, intSize);
+		memcpy(&t_map, index_buffer + 2 * intSize, intSize);
 
 		// ensure stored values are valid before setting member variables
 		// note: we use pid = 0 for the index file by default so we cannot store the tree there
@@ -63,6 +73,15 @@ RC BTreeIndex::open(const string& indexname, char mode)
 			rootPid = t_pid;
 			treeHeight = t_height;
 		}
+
+		// files from before the free-space map have -1 in its place
+		if (t_map > 0) {
+			mapPid = t_map;
+			if (!pf.isReadOnly() && (rc = alloc.open(pf, mapPid)) < 0) {
+				pf.close();
+				return rc;
+			}
+		}
 	}
 
     return 0;
@@ -74,12 +93,15 @@ RC BTreeIndex::open(const string& indexname, char mode)
  */
 RC BTreeIndex::close()
 {
-	memcpy(index_buffer, &rootPid, intSize);
-	memcpy(index_buffer + intSize, &treeHeight, intSize);
-    
+	// an index opened for reading has nothing to store
+	if (pf.isReadOnly()) {
+		return pf.close();
+	}
+
     // store rootpid and treeheight before closing file
-    RC rc = pf.write(0, index_buffer);
+    RC rc = storeRoot();
     if (rc < 0) {
+    	pf.close();
     	return rc;
     }
     
@@ -87,11 +109,12 @@ RC BTreeIndex::close()
 }
 
 //recursive helper for insert
-RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId& nextPid, int& splitKey_t, int& splitPid_t) {
+RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId& nextPid, int& splitKey_t, PageId& splitPid_t) {
 
 	RC rc;
 	bool updateRoot = false;
-	int newPid, siblingKey;
+	PageId newPid;
+	int siblingKey;
 
 	//Leaf case
 	if(currHeight == treeHeight) {
@@ -106,14 +129,20 @@ RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId&
 			leaf.write(nextPid, pf);
 			return 0;
 		}
+		if (rc != RC_NODE_FULL) {
+			return rc;
+		}
 
 		//if insert fails, try insert and split
-		BTLeafNode sibling;
+		BTLeafNode sibling(pf.getPageSize());
 		if( (rc = leaf.insertAndSplit(key, rid, sibling, siblingKey) ) < 0) {
 			return rc;
 		}
 
-		newPid = pf.endPid(); // where we will write the new sibling leaf
+		// where we will write the new sibling leaf, next to the leaf
+		if ((rc = newPage(nextPid, newPid)) < 0) {
+			return rc;
+		}
 
 		// save values of split key and pid so we can propagate and insert further up in nonleafs
 		splitKey_t = siblingKey;
@@ -132,7 +161,7 @@ RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId&
 			return rc;
 		}
 
-		if (treeHeight == 1) {
+		if (currHeight == 1) { // the root split
 			updateRoot = true;
 		}
 	} else {
@@ -141,13 +170,13 @@ RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId&
 			return rc;
 		}	
 
-		int childPid = -1;
+		PageId childPid = -1;
 		if( (rc = nonLeaf.locateChildPtr(key, childPid)) < 0) {
 			return rc;
 		}
 
 		int splitKey = -1;
-		int splitPid = -1;
+		PageId splitPid = -1;
 
 		rc = rec_insert(key, rid, currHeight + 1, childPid, splitKey, splitPid);
 		if(rc < 0) {
@@ -163,12 +192,15 @@ RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId&
 			}
 
 			// if insert fails, try insert and split
-			BTNonLeafNode sibling;
+			BTNonLeafNode sibling(pf.getPageSize());
 			if( (rc = nonLeaf.insertAndSplit(splitKey, splitPid, sibling, siblingKey) ) < 0) {
 				return rc;
 			}
 
-			newPid = pf.endPid(); // where we will write the new sibling nonleaf
+			// where we will write the new sibling nonleaf, next to the nonleaf
+			if ((rc = newPage(nextPid, newPid)) < 0) {
+				return rc;
+			}
 
 			// save values of split key and pid so we can propagate and insert further up in nonleafs
 			splitKey_t = siblingKey;
@@ -183,16 +215,19 @@ RC BTreeIndex::rec_insert(int key, const RecordId& rid, int currHeight, PageId&
 				return rc;
 			}
 
-			if (treeHeight == 1) {
+			if (currHeight == 1) { // the root split
 				updateRoot = true;
 			}
 		}
 	}
 
 	if (updateRoot) {
-		BTNonLeafNode n_root;
+		BTNonLeafNode n_root(pf.getPageSize());
 		n_root.initializeRoot(nextPid, siblingKey, newPid);
-		rootPid = pf.endPid();
+		// the nonleaf nodes are kept together, next to the index data
+		if ((rc = newPage(0, rootPid)) < 0) {
+			return rc;
+		}
 		n_root.write(rootPid, pf);
 		treeHeight++;
 	}
@@ -210,10 +245,15 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 {
 	// create a root
 	if (treeHeight == 0) {
-		BTLeafNode root;
+		BTLeafNode root(pf.getPageSize());
 		root.insert(key, rid);
 
-		int newPid = pf.endPid();
+		// the leaves start out in an extent of their own
+		PageId newPid;
+		RC rc = newPage(-1, newPid);
+		if (rc < 0) {
+			return rc;
+		}
 		if (newPid == 0) {
 			rootPid = 1; // 0 is used for storing index data
 		} else {
@@ -221,11 +261,64 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
 		}
 
 		treeHeight = 1;
-		return root.write(rootPid, pf);
+		rc = root.write(rootPid, pf);
+		if (rc < 0) {
+			return rc;
+		}
+		return storeRoot();
+	}
+
+	int splitKey = -1;
+	PageId splitPid = -1;
+	PageId oldRoot = rootPid;
+	RC rc = rec_insert(key, rid, 1, rootPid, splitKey, splitPid);
+
+	// a new root is stored along with the split that created it, so that
+	// a logged insert leaves a complete tree behind after a crash
+	if (rc == 0 && rootPid != oldRoot) {
+		rc = storeRoot();
+	}
+	return rc;
+}
+
+/*
+ * Store rootPid, treeHeight and mapPid in page 0 of the index file.
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::storeRoot()
+{
+	// the pages of an index are numbered in ints on the disk
+	int t_pid = (int) rootPid, t_map = (int) mapPid;
+	memcpy(index_buffer, &t_pid, intSize);
+	memcpy(index_buffer + intSize, &treeHeight, intSize);
+	memcpy(index_buffer + 2 * intSize, &t_map, intSize);
+	return pf.write(0, index_buffer);
+}
+
+/*
+ * Allocate a page for a new node.
+ * @param near[IN] the node to place it next to. -1 to start a new extent
+ * @param pid[OUT] the page allocated
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::newPage(PageId near, PageId& pid)
+{
+	RC rc = 0;
+
+	// without a free-space map, the file just grows
+	if (!alloc.isOpen()) {
+		pid = pf.endPid();
+	} else if (near < 0) {
+		rc = alloc.allocateExtent(pid);
+	} else {
+		rc = alloc.allocate(near, pid);
 	}
 
-	int splitKey = -1, splitPid = -1;
-    return rec_insert(key, rid, 1, rootPid, splitKey, splitPid);
+	// nodes point to each other with ints
+	if (rc == 0 && pid > INT_MAX) {
+		return RC_INVALID_PID;
+	}
+	return rc;
 }
 
 //recursive helper function for locate
@@ -238,9 +331,10 @@ RC BTreeIndex::search_tree( int searchKey, IndexCursor& cursor, int currHeight,
 
 	RC rc;
 	//base case at leaf
+	//the nodes are only searched, so look at them in place in the buffer pool
 	if(currHeight == treeHeight) {
 		BTLeafNode leaf;
-		if( (rc = leaf.read(nextPid, pf)) < 0) {
+		if( (rc = leaf.pin(nextPid, pf)) < 0) {
 		  return rc;
 		}
 
@@ -254,13 +348,14 @@ RC BTreeIndex::search_tree( int searchKey, IndexCursor& cursor, int currHeight,
 
 	//recursive step check for errors and go down to leaf
 	BTNonLeafNode nonLeaf;
-	if( (rc = nonLeaf.read(nextPid, pf)) < 0) {
+	if( (rc = nonLeaf.pin(nextPid, pf)) < 0) {
 		return rc;
 	}	
 
 	if( (rc = nonLeaf.locateChildPtr(searchKey, nextPid)) < 0) {
 		return rc;
 	}
+	nonLeaf.unpin(); // no need to keep the page while we go down
 
 	return search_tree(searchKey, cursor, currHeight + 1, nextPid);
 
@@ -290,6 +385,35 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
 	return search_tree(searchKey, cursor, 1, tempID); 
 }
 
+/*
+ * Set the cursor to the first entry of the leftmost leaf node, i.e.,
+ * the entry with the smallest key, by following the first child
+ * pointers down from the root.
+ * @param cursor[OUT] the cursor pointing to the first index entry
+ * @return 0 if successful. RC_NO_SUCH_RECORD if the index is empty
+ */
+RC BTreeIndex::locateFirst(IndexCursor& cursor)
+{
+	if (treeHeight == 0) {
+		return RC_NO_SUCH_RECORD;
+	}
+
+	RC rc;
+	PageId pid = rootPid;
+	BTNonLeafNode nonLeaf;
+	for (int h = 1; h < treeHeight; h++) {
+		if ((rc = nonLeaf.pin(pid, pf)) < 0) {
+			return rc;
+		}
+		pid = nonLeaf.getFirstChildPtr();
+		nonLeaf.unpin();
+	}
+
+	cursor.pid = pid;
+	cursor.eid = 0;
+	return 0;
+}
+
 /*
  * Read the (key, rid) pair at the location specified by the index cursor,
  * and move foward the cursor to the next entry.
@@ -303,7 +427,8 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
 	RC rc;
 	BTLeafNode leaf;
 
-	rc = leaf.read(cursor.pid, pf);
+	rc = leaf.pin(cursor.pid, pf); // the leaf is only read
+
 	if(rc < 0) {
 		return rc;
 	}
@@ -12,6 +12,7 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "PageAllocator.h"
 #include "RecordFile.h"
 
 const int intSize = sizeof(int);
@@ -41,7 +42,7 @@ class BTreeIndex {
    * Open the index file in read or write mode.
    * Under 'w' mode, the index file should be created if it does not exist.
    * @param indexname[IN] the name of the index file
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for mapped read
    * @return error code. 0 if no error
    */
   RC open(const std::string& indexname, char mode);
@@ -53,7 +54,7 @@ class BTreeIndex {
   RC close();
     
   //helper for insert
-  RC rec_insert(int key, const RecordId& rid, int currHeight, PageId& nextPid, int& splitKey_t, int& splitPid_t);  
+  RC rec_insert(int key, const RecordId& rid, int currHeight, PageId& nextPid, int& splitKey_t, PageId& splitPid_t);  
   /**
    * Insert (key, RecordId) pair to the index.
    * @param key[IN] the key for the value inserted into the index
@@ -85,6 +86,15 @@ class BTreeIndex {
    */
   RC locate(int searchKey, IndexCursor& cursor);
 
+  /**
+   * Set the cursor to the first entry of the leftmost leaf node, i.e.,
+   * the entry with the smallest key, by following the first child
+   * pointers down from the root.
+   * @param cursor[OUT] the cursor pointing to the first index entry
+   * @return 0 if successful. RC_NO_SUCH_RECORD if the index is empty
+   */
+  RC locateFirst(IndexCursor& cursor);
+
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
    * and move foward the cursor to the next entry.
@@ -95,6 +105,11 @@ class BTreeIndex {
    */
   RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
 
+  /**
+   * @return the I/O statistics of the index file since it was opened
+   */
+  IoStats getStats() const { return pf.getStats(); }
+
   // THE FOLLOWING ARE FOR TESTING
   int getTreeHeight();
 
@@ -103,8 +118,12 @@ class BTreeIndex {
  private:
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
+  PageAllocator alloc; /// places new nodes near their siblings in the file
+
   PageId   rootPid;    /// the PageId of the root node
   int      treeHeight; /// the height of the tree
+  PageId   mapPid;     /// the first page of the free-space map. -1 if the
+                       /// file has none, and new nodes go at its end
   /// Note that the content of the above two variables will be gone when
   /// this class is destructed. Make sure to store the values of the two 
   /// variables in disk, so that they can be reconstructed when the index
@@ -114,7 +133,21 @@ class BTreeIndex {
   // use pagefile with pid = 0 for this
   // although we store only two variables in here, we write to a whole page
   // ^therefore we just set the size of the buffer to the page size
-  char index_buffer[PageFile::PAGE_SIZE];
+  char index_buffer[PageFile::MAX_PAGE_SIZE];
+
+  /**
+   * Store rootPid, treeHeight and mapPid in page 0 of the index file.
+   * @return error code. 0 if no error
+   */
+  RC storeRoot();
+
+  /**
+   * Allocate a page for a new node.
+   * @param near[IN] the node to place it next to. -1 to start a new extent
+   * @param pid[OUT] the page allocated
+   * @return error code. 0 if no error
+   */
+  RC newPage(PageId near, PageId& pid);
 };
 
 #endif /* BTREEINDEX_H */
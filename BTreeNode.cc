@@ -5,12 +5,86 @@
 
 using namespace std;
 
-BTLeafNode::BTLeafNode(){//(PageId pid){
-	std::fill(buffer, buffer+ PageFile::PAGE_SIZE, -1); //Initialize buffer to some value
+//
+// page ids are 64-bit in memory, but nodes store them compactly so that
+// their fanout stays the same. a RecordId takes 8 bytes: the low 32 bits
+// of its pid, its sid in 16 bits, and the next 16 bits of the pid, which
+// is laid out as the (pid, sid) pair of two ints that nodes used to hold,
+// as long as the pid fits in 32 bits. pointers to other nodes, within the
+// index file, are ints, with -1 for none.
+//
+static const int NODE_PTR_SIZE = sizeof(int);  // # of bytes of a pointer to a node
+static const int RID_SIZE = 8;                 // # of bytes of a RecordId
+static const PageId MAX_RID_PID = (1LL << 48) - 1;  // the largest pid a RecordId can hold
+static const int MAX_RID_SID = 0xFFFF;              // the largest sid a RecordId can hold
+
+// store a pointer to a node
+static void putNodePtr(char* p, PageId pid)
+{
+	int n = (int) pid;
+	memcpy(p, &n, NODE_PTR_SIZE);
+}
+
+// load a pointer to a node
+static PageId getNodePtr(const char* p)
+{
+	int n;
+	memcpy(&n, p, NODE_PTR_SIZE);
+	return n;
+}
+
+// store a RecordId, which must be within MAX_RID_PID and MAX_RID_SID
+static void putRecordId(char* p, const RecordId& rid)
+{
+	unsigned low = (unsigned) rid.pid;
+	unsigned short sid = (unsigned short) rid.sid;
+	unsigned short high = (unsigned short) (rid.pid >> 32);
+	memcpy(p, &low, 4);
+	memcpy(p + 4, &sid, 2);
+	memcpy(p + 6, &high, 2);
+}
+
+// load a RecordId
+static void getRecordId(const char* p, RecordId& rid)
+{
+	unsigned low;
+	unsigned short sid, high;
+	memcpy(&low, p, 4);
+	memcpy(&sid, p + 4, 2);
+	memcpy(&high, p + 6, 2);
+	rid.pid = ((PageId) high << 32) | low;
+	rid.sid = sid;
+}
+
+BTLeafNode::BTLeafNode(int size){//(PageId pid){
+	pageSize = size;
+	owned = (char*) malloc(pageSize);
+	buffer = owned;
+	pinFile = NULL;
+	pinPid = -1;
+	std::fill(buffer, buffer+ pageSize, -1); //Initialize buffer to some value
 														//Do we want to use -1 or 0?
 	//m_pid = pid;
 }
 
+BTLeafNode::~BTLeafNode(){
+	unpin();
+	free(owned);
+}
+
+/*
+ * Make the buffer owned by the node size bytes large.
+ * @param size[IN] the page size of the PageFile the node is stored in
+ */
+void BTLeafNode::setPageSize(int size)
+{
+	if (size != pageSize) {
+		pageSize = size;
+		owned = (char*) realloc(owned, pageSize);
+		buffer = owned;
+	}
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -18,7 +92,50 @@ BTLeafNode::BTLeafNode(){//(PageId pid){
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::read(PageId pid, const PageFile& pf)
-{ return pf.read(pid, buffer); }
+{
+	unpin();
+
+	// the node takes on the page size of the file it is read from
+	setPageSize(pf.getPageSize());
+	return pf.read(pid, buffer);
+}
+
+/*
+ * Look at the node in the page pid of the PageFile pf in place.
+ * @param pid[IN] the PageId to pin
+ * @param pf[IN] PageFile to pin the page of
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::pin(PageId pid, const PageFile& pf)
+{
+	RC rc;
+	const char* page;
+
+	unpin();
+	setPageSize(pf.getPageSize());
+	if ((rc = pf.pin(pid, page)) < 0) {
+		return rc;
+	}
+
+	// the node is only read while pinned, so the page stays untouched
+	buffer = (char*) page;
+	pinFile = &pf;
+	pinPid = pid;
+	return 0;
+}
+
+/*
+ * Release the page pinned by pin() and go back to the node's own buffer.
+ */
+void BTLeafNode::unpin()
+{
+	if (pinFile != NULL) {
+		pinFile->unpin(pinPid);
+		pinFile = NULL;
+		pinPid = -1;
+		buffer = owned;
+	}
+}
     
 /*
  * Write the content of the node to the page pid in the PageFile pf.
@@ -27,7 +144,12 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTLeafNode::write(PageId pid, PageFile& pf)
-{ return pf.write(pid, buffer); }
+{
+	if (pf.getPageSize() != pageSize) {
+		return RC_INVALID_FILE_FORMAT;
+	}
+	return pf.write(pid, buffer);
+}
 
 /*
  * Return the number of keys stored in the node.
@@ -35,15 +157,15 @@ RC BTLeafNode::write(PageId pid, PageFile& pf)
  */
 int BTLeafNode::getKeyCount()
 { 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int intSize = sizeof(int); 
-	int pairSize = intSize + sizeof(RecordId);
+	int pairSize = intSize + RID_SIZE;
 	int keyCount = 0;
 	char* bufPtr = buffer;
 	int i = 0;
 	int key;
 
-	for(; i < PageFile::PAGE_SIZE - pageIdSize; i += pairSize, bufPtr += pairSize ) {
+	for(; i < pageSize - pageIdSize; i += pairSize, bufPtr += pairSize ) {
 		memcpy(&key, bufPtr, intSize);
 		if(key == -1) break;  //If hit an element in the buffer we didn't set, stop counting. NOTE: change compare to -1 or 0 based off initialization
 		keyCount++;
@@ -58,21 +180,26 @@ int BTLeafNode::getKeyCount()
  */
 RC BTLeafNode::insert(int key, const RecordId& rid)
 { 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int intSize = sizeof(int);
 	PageId nextPtr;
 	char* bufPtr = buffer;
-	memcpy(&nextPtr, bufPtr + PageFile::PAGE_SIZE - pageIdSize, pageIdSize);
+	nextPtr = getNodePtr(bufPtr + pageSize - pageIdSize);
+
+	if (rid.pid < 0 || rid.pid > MAX_RID_PID || rid.sid < 0 || rid.sid > MAX_RID_SID) {
+		return RC_INVALID_RID; // does not fit in the entry
+	}
 
-	int pairSize = sizeof(int) + sizeof(RecordId);
-	if(getKeyCount() + 1 > (PageFile::PAGE_SIZE - pageIdSize)/pairSize ) { 
+	int pairSize = sizeof(int) + RID_SIZE;
+	int keyCount = getKeyCount();
+	if(keyCount + 1 > (pageSize - pageIdSize)/pairSize ) { 
 		return RC_NODE_FULL;
 	}
 
 	//assuming keys are in ascending order, makes checking with -1 easy
 	int i = 0;
 	int keyTmp;
-	for(; i < getKeyCount() * pairSize; i += pairSize, bufPtr += pairSize) {	
+	for(; i < keyCount * pairSize; i += pairSize, bufPtr += pairSize) {	
 		memcpy(&keyTmp, bufPtr, intSize);
 		if(keyTmp == -1 || !(key > keyTmp)) {break;} //stop when at end of keys or key we want to insert is greater than key in buffer
 
@@ -82,15 +209,14 @@ RC BTLeafNode::insert(int key, const RecordId& rid)
 	//Copy the the buffer into the tmp buffer until the point where we stopped in the loop above
 	// Insert key,value pair and then the rest of the buffer into the tmp buffer
 	//Now copy the whole tmp buffer back and overwrite the buffer
-	int keyCount = getKeyCount();
-	char* tmpBuf = (char*) malloc(PageFile::PAGE_SIZE);
-	std::fill(tmpBuf, tmpBuf+ PageFile::PAGE_SIZE, -1);
+	char* tmpBuf = (char*) malloc(pageSize);
+	std::fill(tmpBuf, tmpBuf+ pageSize, -1);
 	memcpy(tmpBuf, buffer, i);
 	memcpy(tmpBuf + i, &key, intSize);
-	memcpy(tmpBuf + i + intSize, &rid, sizeof(RecordId));
+	putRecordId(tmpBuf + i + intSize, rid);
 	memcpy(tmpBuf + i + pairSize, buffer + i, keyCount * pairSize - i);
-	memcpy(tmpBuf + PageFile::PAGE_SIZE - pageIdSize, &nextPtr, pageIdSize);
-	memcpy(buffer, tmpBuf, PageFile::PAGE_SIZE);
+	putNodePtr(tmpBuf + pageSize - pageIdSize, nextPtr);
+	memcpy(buffer, tmpBuf, pageSize);
 	free(tmpBuf);
 
 	return 0;
@@ -110,14 +236,14 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
                               BTLeafNode& sibling, int& siblingKey)
 { 
 	int intSize = sizeof(int); 
-	int pairSize = intSize + sizeof(RecordId);
-	int pageIdSize = sizeof(PageId);
+	int pairSize = intSize + RID_SIZE;
+	int pageIdSize = NODE_PTR_SIZE;
 
 
-	if(!(getKeyCount() + 1 > (PageFile::PAGE_SIZE - pageIdSize)/pairSize )) { 
+	if(!(getKeyCount() + 1 > (pageSize - pageIdSize)/pairSize )) { 
 		return RC_INVALID_FILE_FORMAT; //trying to split when there is no overflow results in bad format
 	}
-	if(sibling.getKeyCount() != 0) {
+	if(sibling.getKeyCount() != 0 || sibling.pageSize != pageSize) {
 		return RC_INVALID_ATTRIBUTE; //sibling must be empty, if it isnt this is invalid
 	}	
 
@@ -125,18 +251,18 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
 
 	PageId nextPtr;
 	char* bufPtr = buffer;
-	memcpy(&nextPtr, bufPtr + PageFile::PAGE_SIZE - pageIdSize, pageIdSize);	
+	nextPtr = getNodePtr(bufPtr + pageSize - pageIdSize);	
 
 	int keepKeysCount = ((int)((getKeyCount() + 1)/2)); //number of keys to keep in this node
 	int splitIndex = keepKeysCount*pairSize; //index to split at
 
 	//copy everything past the split index to the sibling
-	memcpy(sibling.buffer, buffer + splitIndex, PageFile::PAGE_SIZE - pageIdSize - splitIndex);
+	memcpy(sibling.buffer, buffer + splitIndex, pageSize - pageIdSize - splitIndex);
 	sibling.setNextNodePtr(nextPtr); 
 	//setNextNodePtr(sibling.m_pid);
 
 	//clear pairs that we copied over to sibling from this node
-	std::fill(buffer + splitIndex, buffer + PageFile::PAGE_SIZE - pageIdSize, -1);
+	std::fill(buffer + splitIndex, buffer + pageSize - pageIdSize, -1);
 
 	//INSERTION CODE
 	memcpy(&siblingKey, sibling.buffer, intSize); //first key in sibling
@@ -148,7 +274,7 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
 	RecordId siblingRid; //We need to intialize the sid and pid of sibling's rid
 	siblingRid.sid = -1;
 	siblingRid.pid = -1;
-	memcpy(&siblingRid, sibling.buffer + intSize, sizeof(RecordId));
+	getRecordId(sibling.buffer + intSize, siblingRid);
 
 	return 0; 
 }
@@ -167,7 +293,7 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
 RC BTLeafNode::locate(int searchKey, int& eid)
 { 
 	int intSize = sizeof(int);
-	int pairSize = sizeof(int) + sizeof(RecordId);
+	int pairSize = sizeof(int) + RID_SIZE;
 	char* bufPtr = buffer;
 	int i = 0;
 	int condition = getKeyCount()  * pairSize;
@@ -199,12 +325,12 @@ RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 		return RC_NO_SUCH_RECORD;
 	}
 	int intSize = sizeof(int);
-	int pairSize = sizeof(int) + sizeof(RecordId);
+	int pairSize = sizeof(int) + RID_SIZE;
 	char* bufPtr = buffer;
 	int pairLocation = eid * pairSize;
 
 	memcpy(&key, bufPtr + pairLocation, intSize);
-	memcpy(&rid, bufPtr + pairLocation + intSize, sizeof(rid));
+	getRecordId(bufPtr + pairLocation + intSize, rid);
 
 	return 0;
 }
@@ -217,7 +343,7 @@ PageId BTLeafNode::getNextNodePtr()
 { 
 	PageId pid;
 	char* bufPtr = buffer;
-	memcpy(&pid, bufPtr + PageFile::PAGE_SIZE - sizeof(PageId), sizeof(PageId));
+	pid = getNodePtr(bufPtr + pageSize - NODE_PTR_SIZE);
 	return pid;
 }
 
@@ -231,17 +357,40 @@ RC BTLeafNode::setNextNodePtr(PageId pid)
 	if(pid < 0){ return RC_INVALID_PID;}
 
 	char* bufPtr = buffer;
-	memcpy(bufPtr + PageFile::PAGE_SIZE - sizeof(PageId), &pid, sizeof(PageId));
+	putNodePtr(bufPtr + pageSize - NODE_PTR_SIZE, pid);
 	return 0; 
 }
 
 
-BTNonLeafNode::BTNonLeafNode(){ //(PageId pid){
-	std::fill(buffer, buffer+ PageFile::PAGE_SIZE, -1); //Initialize buffer to some value
+BTNonLeafNode::BTNonLeafNode(int size){ //(PageId pid){
+	pageSize = size;
+	owned = (char*) malloc(pageSize);
+	buffer = owned;
+	pinFile = NULL;
+	pinPid = -1;
+	std::fill(buffer, buffer+ pageSize, -1); //Initialize buffer to some value
 														//Do we want to use -1 or 0?
 	//m_pid = pid;
 }
 
+BTNonLeafNode::~BTNonLeafNode(){
+	unpin();
+	free(owned);
+}
+
+/*
+ * Make the buffer owned by the node size bytes large.
+ * @param size[IN] the page size of the PageFile the node is stored in
+ */
+void BTNonLeafNode::setPageSize(int size)
+{
+	if (size != pageSize) {
+		pageSize = size;
+		owned = (char*) realloc(owned, pageSize);
+		buffer = owned;
+	}
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -249,7 +398,50 @@ BTNonLeafNode::BTNonLeafNode(){ //(PageId pid){
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
-{ return pf.read(pid, buffer); }
+{
+	unpin();
+
+	// the node takes on the page size of the file it is read from
+	setPageSize(pf.getPageSize());
+	return pf.read(pid, buffer);
+}
+
+/*
+ * Look at the node in the page pid of the PageFile pf in place.
+ * @param pid[IN] the PageId to pin
+ * @param pf[IN] PageFile to pin the page of
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::pin(PageId pid, const PageFile& pf)
+{
+	RC rc;
+	const char* page;
+
+	unpin();
+	setPageSize(pf.getPageSize());
+	if ((rc = pf.pin(pid, page)) < 0) {
+		return rc;
+	}
+
+	// the node is only read while pinned, so the page stays untouched
+	buffer = (char*) page;
+	pinFile = &pf;
+	pinPid = pid;
+	return 0;
+}
+
+/*
+ * Release the page pinned by pin() and go back to the node's own buffer.
+ */
+void BTNonLeafNode::unpin()
+{
+	if (pinFile != NULL) {
+		pinFile->unpin(pinPid);
+		pinFile = NULL;
+		pinPid = -1;
+		buffer = owned;
+	}
+}
     
 /*
  * Write the content of the node to the page pid in the PageFile pf.
@@ -258,7 +450,12 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
  * @return 0 if successful. Return an error code if there is an error.
  */
 RC BTNonLeafNode::write(PageId pid, PageFile& pf)
-{ return pf.write(pid,buffer); }
+{
+	if (pf.getPageSize() != pageSize) {
+		return RC_INVALID_FILE_FORMAT;
+	}
+	return pf.write(pid,buffer);
+}
 
 /*
  * Return the number of keys stored in the node.
@@ -270,14 +467,14 @@ int BTNonLeafNode::getKeyCount(){
 	// [pid | key | pid | ... | key | pid]
 
 	int intSize = sizeof(int); 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int pairSize = intSize + pageIdSize;
 	int keyCount = 0;
 	char* bufPtr = buffer + pageIdSize;
 	int i = pageIdSize;
 	int key;
 
-	for(; i < PageFile::PAGE_SIZE - pageIdSize; i += pairSize, 	bufPtr += pairSize) {
+	for(; i < pageSize - pageIdSize; i += pairSize, 	bufPtr += pairSize) {
 		memcpy(&key, bufPtr, intSize);
 		if(key == -1) break;  //If hit an element in the buffer we didn't set, stop counting. NOTE: change compare to -1 or 0 based off initialization
 		keyCount++;
@@ -297,20 +494,20 @@ RC BTNonLeafNode::insert(int key, PageId pid)
 	// representation:
 	// [pid | key | pid | ... | key | pid]
 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int intSize = sizeof(int);
 	char* bufPtr = buffer+pageIdSize;
 
 	int pairSize = intSize + pageIdSize;
 	int keyCount = getKeyCount();
-	if(keyCount + 1 > (PageFile::PAGE_SIZE - pageIdSize)/pairSize ) { 
+	if(keyCount + 1 > (pageSize - pageIdSize)/pairSize ) { 
 		return RC_NODE_FULL;
 	}
 
 	//assuming keys are in ascending order, makes checking with -1 easy
 	int i = pageIdSize;
 	int keyTmp;
-	for(; i < PageFile::PAGE_SIZE - pairSize ; i += pairSize, bufPtr += pairSize) {	
+	for(; i < pageSize - pairSize ; i += pairSize, bufPtr += pairSize) {	
 		memcpy(&keyTmp, bufPtr, intSize);
 		if(keyTmp == -1 || !(key > keyTmp)) {break;} //stop when at end of keys or key we want to insert is greater than key in buffer
 
@@ -319,13 +516,13 @@ RC BTNonLeafNode::insert(int key, PageId pid)
 	//Copy the the buffer into the tmp buffer until the point where we stopped in the loop above
 	// Insert key,value pair and then the rest of the buffer into the tmp buffer
 	//Now copy the whole tmp buffer back and overwrite the buffer
-	char* tmpBuf = (char*) malloc(PageFile::PAGE_SIZE); 
-	std::fill(tmpBuf, tmpBuf+ PageFile::PAGE_SIZE, -1);
+	char* tmpBuf = (char*) malloc(pageSize); 
+	std::fill(tmpBuf, tmpBuf+ pageSize, -1);
 	memcpy(tmpBuf, buffer, i); 
 	memcpy(tmpBuf + i, &key, intSize); 
-	memcpy(tmpBuf + i + intSize, &pid, pageIdSize); 
+	putNodePtr(tmpBuf + i + intSize, pid);
 	memcpy(tmpBuf + i + pairSize, buffer + i, keyCount * pairSize - i + pageIdSize);
-	memcpy(buffer, tmpBuf, PageFile::PAGE_SIZE);
+	memcpy(buffer, tmpBuf, pageSize);
 	free(tmpBuf);
 	return 0;
 }
@@ -343,14 +540,14 @@ RC BTNonLeafNode::insert(int key, PageId pid)
 RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
 { 
 	int intSize = sizeof(int); 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int pairSize = intSize + pageIdSize;
 
 
-	if(!(getKeyCount() + 1 > (PageFile::PAGE_SIZE - pageIdSize)/pairSize )) { 
+	if(!(getKeyCount() + 1 > (pageSize - pageIdSize)/pairSize )) { 
 		return RC_INVALID_FILE_FORMAT; //trying to split when there is no overflow results in bad format
 	}
-	if(sibling.getKeyCount() != 0) {
+	if(sibling.getKeyCount() != 0 || sibling.pageSize != pageSize) {
 		return RC_INVALID_ATTRIBUTE; //sibling must be empty, if it isnt this is invalid
 	}
 
@@ -369,27 +566,27 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
 
 	if (key < last_leftkey) { // last_leftkey is median key
 		memcpy(sibling.buffer, buffer + splitIndex - pageIdSize, pageIdSize);
-		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex, PageFile::PAGE_SIZE - splitIndex);
+		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex, pageSize - splitIndex);
 		memcpy(&midKey, buffer + splitIndex - pairSize, intSize);
 
-		std::fill(buffer + splitIndex - pairSize, buffer + PageFile::PAGE_SIZE, -1); // remove copied over elements
+		std::fill(buffer + splitIndex - pairSize, buffer + pageSize, -1); // remove copied over elements
 
 		insert(key, pid);
 
 	} else if (key > first_rightkey) { // first_rightkey is median key
 		memcpy(sibling.buffer, buffer + splitIndex + intSize, pageIdSize); // pid
-		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex + pairSize, PageFile::PAGE_SIZE - splitIndex - pairSize);
+		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex + pairSize, pageSize - splitIndex - pairSize);
 		memcpy(&midKey, buffer + splitIndex, intSize); // save mid key
 
-		std::fill(buffer + splitIndex, buffer + PageFile::PAGE_SIZE, -1);
+		std::fill(buffer + splitIndex, buffer + pageSize, -1);
 
 		sibling.insert(key, pid);
 
 	} else { // key is median key
-		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex, PageFile::PAGE_SIZE - splitIndex);
-		memcpy(sibling.buffer, &pid, pageIdSize);
+		memcpy(sibling.buffer + pageIdSize, buffer + splitIndex, pageSize - splitIndex);
+		putNodePtr(sibling.buffer, pid);
 		midKey = key;
-		std::fill(buffer + splitIndex, buffer + PageFile::PAGE_SIZE, -1);
+		std::fill(buffer + splitIndex, buffer + pageSize, -1);
 	}
 
 	return 0;
@@ -407,13 +604,13 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 	// representation:
 	// [pid | key | pid | ... | key | pid]
 
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int intSize = sizeof(int);
 	int pairSize = intSize + pageIdSize;
 
 	char* bufPtr = buffer + pageIdSize; // start at first key
 	int i = pageIdSize;
-	for (; i < PageFile::PAGE_SIZE - pageIdSize; i += pairSize, bufPtr += pairSize) {
+	for (; i < pageSize - pageIdSize; i += pairSize, bufPtr += pairSize) {
 		int keyTmp;
 		memcpy(&keyTmp, bufPtr, intSize);
 
@@ -424,16 +621,28 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 
 		// return pid to left
 		if (keyTmp > searchKey) {
-			memcpy(&pid, bufPtr - pageIdSize, pageIdSize);
+			pid = getNodePtr(bufPtr - pageIdSize);
 			return 0;
 		}
 	}
 
 	// copy pointer to next node
-	memcpy(&pid, bufPtr - pageIdSize, pageIdSize);
+	pid = getNodePtr(bufPtr - pageIdSize);
 	return 0;
 }
 
+/*
+ * Return the pointer to the leftmost child node, which holds the
+ * keys smaller than all keys of the node.
+ * @return the PageId of the first child node
+ */
+PageId BTNonLeafNode::getFirstChildPtr()
+{
+	// representation:
+	// [pid | key | pid | ... | key | pid]
+	return getNodePtr(buffer);
+}
+
 /*
  * Initialize the root node with (pid1, key, pid2).
  * @param pid1[IN] the first PageId to insert
@@ -443,15 +652,15 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
  */
 RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
 { 
-	std::fill(buffer, buffer + PageFile::PAGE_SIZE, -1); // initialize buffer contents
+	std::fill(buffer, buffer + pageSize, -1); // initialize buffer contents
 
 	char* bufptr = buffer;
-	int pageIdSize = sizeof(PageId);
+	int pageIdSize = NODE_PTR_SIZE;
 	int intSize = sizeof(int);
 
-	memcpy(bufptr, &pid1, pageIdSize);
+	putNodePtr(bufptr, pid1);
 	memcpy(bufptr + pageIdSize, &key, intSize);
-	memcpy(bufptr + pageIdSize + intSize, &pid2, pageIdSize);
+	putNodePtr(bufptr + pageIdSize + intSize, pid2);
 
 	return 0;
 }
@@ -20,13 +20,19 @@ class BTLeafNode {
   public:
 
     //BTLeafNode(PageId pid);
-    BTLeafNode();
+   /**
+    * Create an empty node for a PageFile with the given page size.
+    * @param size[IN] the page size of the PageFile the node is stored in
+    */
+    BTLeafNode(int size = PageFile::PAGE_SIZE);
+    ~BTLeafNode();
 
    /**
     * Insert the (key, rid) pair to the node.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
-    * @param rid[IN] the RecordId to insert
+    * @param rid[IN] the RecordId to insert. its pid must fit in 48 bits
+    *                and its sid in 16 bits
     * @return 0 if successful. Return an error code if the node is full.
     */
     RC insert(int key, const RecordId& rid);
@@ -93,6 +99,23 @@ class BTLeafNode {
     * @return 0 if successful. Return an error code if there is an error.
     */
     RC read(PageId pid, const PageFile& pf);
+
+   /**
+    * Look at the node in the page pid of the PageFile pf in place,
+    * without copying the page. The page stays pinned in the buffer pool
+    * until unpin(), read() or the destruction of the node, and the node
+    * must not be modified meanwhile.
+    * @param pid[IN] the PageId to pin
+    * @param pf[IN] PageFile to pin the page of
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC pin(PageId pid, const PageFile& pf);
+
+   /**
+    * Release the page pinned by pin(). The node must be read() again
+    * before it is used afterwards.
+    */
+    void unpin();
     
    /**
     * Write the content of the node to the page pid in the PageFile pf.
@@ -105,10 +128,22 @@ class BTLeafNode {
   private:
    /**
     * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * that contains the node. It is pageSize bytes long, and points
+    * into the buffer pool while the page is pinned.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+    int   pageSize;
+    char* owned;              // the buffer of the node when it is not pinned
+    const PageFile* pinFile;  // the file of the pinned page (NULL: none)
+    PageId pinPid;            // the pinned page
    // PageId m_pid; //pid of this node
+
+    // nodes own their buffer and are not copied
+    BTLeafNode(const BTLeafNode&);
+    BTLeafNode& operator=(const BTLeafNode&);
+
+    // resize the owned buffer to the page size of a file
+    void setPageSize(int size);
 }; 
 
 
@@ -118,7 +153,12 @@ class BTLeafNode {
 class BTNonLeafNode {
   public:
    // BTNonLeafNode(PageId pid);
-     BTNonLeafNode();
+   /**
+    * Create an empty node for a PageFile with the given page size.
+    * @param size[IN] the page size of the PageFile the node is stored in
+    */
+     BTNonLeafNode(int size = PageFile::PAGE_SIZE);
+     ~BTNonLeafNode();
    /**
     * Insert a (key, pid) pair to the node.
     * Remember that all keys inside a B+tree node should be kept sorted.
@@ -152,6 +192,13 @@ class BTNonLeafNode {
     */
     RC locateChildPtr(int searchKey, PageId& pid);
 
+   /**
+    * Return the pointer to the leftmost child node, which holds the
+    * keys smaller than all keys of the node.
+    * @return the PageId of the first child node
+    */
+    PageId getFirstChildPtr();
+
    /**
     * Initialize the root node with (pid1, key, pid2).
     * @param pid1[IN] the first PageId to insert
@@ -174,6 +221,23 @@ class BTNonLeafNode {
     * @return 0 if successful. Return an error code if there is an error.
     */
     RC read(PageId pid, const PageFile& pf);
+
+   /**
+    * Look at the node in the page pid of the PageFile pf in place,
+    * without copying the page. The page stays pinned in the buffer pool
+    * until unpin(), read() or the destruction of the node, and the node
+    * must not be modified meanwhile.
+    * @param pid[IN] the PageId to pin
+    * @param pf[IN] PageFile to pin the page of
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC pin(PageId pid, const PageFile& pf);
+
+   /**
+    * Release the page pinned by pin(). The node must be read() again
+    * before it is used afterwards.
+    */
+    void unpin();
     
    /**
     * Write the content of the node to the page pid in the PageFile pf.
@@ -186,10 +250,22 @@ class BTNonLeafNode {
   private:
    /**
     * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * that contains the node. It is pageSize bytes long, and points
+    * into the buffer pool while the page is pinned.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    char* buffer;
+    int   pageSize;
+    char* owned;              // the buffer of the node when it is not pinned
+    const PageFile* pinFile;  // the file of the pinned page (NULL: none)
+    PageId pinPid;            // the pinned page
     //PageId m_pid; //pid of this node
+
+    // nodes own their buffer and are not copied
+    BTNonLeafNode(const BTNonLeafNode&);
+    BTNonLeafNode& operator=(const BTNonLeafNode&);
+
+    // resize the owned buffer to the page size of a file
+    void setPageSize(int size);
 }; 
 
 #endif /* BTREENODE_H */
@@ -0,0 +1,174 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// insert keys in random order into a B+tree index, enough for the root
+// to split after it became a non-leaf node, and check that every key
+// is found, both right away and after the index is reopened, and that
+// a scan from the leftmost leaf reads all keys in order. then look up
+// keys from several threads in a pool too small for the index, so that
+// pages are pinned while others are evicted, and check the pin counts.
+//
+// usage: btreetest [keys]
+//
+
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "PageFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+using std::vector;
+
+static const char* INDEX_FILE = "btreetest.idx";
+static const int THREADS = 4;       // # of threads looking up keys at once
+static const int POOL_PAGES = 16;   // the pool they share
+static int running;                 // # of threads still looking up keys
+
+struct Lookups {
+  BTreeIndex* tree;
+  int  keyCount;
+  unsigned seed;  // for rand_r()
+  int  lookups;   // # of keys to look up
+  int  missing;   // # of keys not found with their rid
+};
+
+// look up random keys while the other threads do the same
+static void* lookupMain(void* arg)
+{
+  Lookups* l = (Lookups*) arg;
+  IndexCursor cursor;
+  RecordId rid;
+  int key;
+
+  for (int i = 0; i < l->lookups; i++) {
+    int searchKey = rand_r(&l->seed) % l->keyCount;
+    if (l->tree->locate(searchKey, cursor) < 0 || l->tree->readForward(cursor, key, rid) < 0 ||
+        key != searchKey || rid.pid != searchKey) {
+      l->missing++;
+    }
+  }
+  __atomic_sub_fetch(&running, 1, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+// @return # of the keys 0 .. keyCount - 1 that are not found with the rid they were inserted with
+static int countMissing(BTreeIndex& tree, int keyCount)
+{
+  int missing = 0;
+
+  for (int i = 0; i < keyCount; i++) {
+    IndexCursor cursor;
+    RecordId rid;
+    int key;
+    if (tree.locate(i, cursor) < 0 || tree.readForward(cursor, key, rid) < 0 ||
+        key != i || rid.pid != i || rid.sid != i % 7) {
+      missing++;
+    }
+  }
+  return missing;
+}
+
+// @return # of the keys 0 .. keyCount - 1 that a scan from the first entry does not read in order
+static int countUnordered(BTreeIndex& tree, int keyCount)
+{
+  IndexCursor cursor;
+  RecordId rid;
+  int key;
+  int i = 0;
+
+  if (tree.locateFirst(cursor) == 0) {
+    while (i < keyCount && tree.readForward(cursor, key, rid) == 0 && key == i) i++;
+  }
+  return keyCount - i;
+}
+
+int main(int argc, char* argv[])
+{
+  int keyCount = (argc > 1) ? atoi(argv[1]) : 100000;
+  if (keyCount <= 0) {
+    fprintf(stderr, "usage: %s [keys]\n", argv[0]);
+    return 1;
+  }
+
+  BTreeIndex tree;
+  unlink(INDEX_FILE);
+  if (tree.open(INDEX_FILE, 'w') < 0) {
+    fprintf(stderr, "cannot create %s\n", INDEX_FILE);
+    return 1;
+  }
+
+  vector<int> keys(keyCount);
+  for (int i = 0; i < keyCount; i++) keys[i] = i;
+  unsigned seed = 1;
+  for (int i = keyCount - 1; i > 0; i--) std::swap(keys[i], keys[rand_r(&seed) % (i + 1)]);
+  for (int i = 0; i < keyCount; i++) {
+    RecordId rid;
+    rid.pid = keys[i];
+    rid.sid = keys[i] % 7;
+    if (tree.insert(keys[i], rid) < 0) {
+      fprintf(stderr, "cannot insert key %d\n", keys[i]);
+      return 1;
+    }
+  }
+
+  int missing = countMissing(tree, keyCount) + countUnordered(tree, keyCount);
+  tree.close();
+  if (tree.open(INDEX_FILE, 'r') < 0) {
+    fprintf(stderr, "cannot open %s\n", INDEX_FILE);
+    return 1;
+  }
+  int missingReopened = countMissing(tree, keyCount) + countUnordered(tree, keyCount);
+  tree.close();
+
+  // every lookup evicts pages that the other threads may be pinning,
+  // or hitting without the lock. the pins never go negative, and are
+  // all released once the threads are done.
+  if (PageFile::setCacheSize(POOL_PAGES) < 0 || tree.open(INDEX_FILE, 'r') < 0) {
+    fprintf(stderr, "cannot open %s\n", INDEX_FILE);
+    return 1;
+  }
+  Lookups lookups[THREADS];
+  pthread_t threads[THREADS];
+  running = THREADS;
+  for (int i = 0; i < THREADS; i++) {
+    lookups[i].tree = &tree;
+    lookups[i].keyCount = keyCount;
+    lookups[i].seed = i + 1;
+    lookups[i].lookups = keyCount;
+    lookups[i].missing = 0;
+    pthread_create(&threads[i], NULL, lookupMain, &lookups[i]);
+  }
+  int lowest, fewest = 0;
+  while (__atomic_load_n(&running, __ATOMIC_SEQ_CST) > 0) {
+    PageFile::countPins(lowest);
+    if (lowest < fewest) fewest = lowest;
+    usleep(100);
+  }
+  int missingConcurrent = 0;
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    missingConcurrent += lookups[i].missing;
+  }
+  int pins = PageFile::countPins(lowest);
+  if (lowest < fewest) fewest = lowest;
+  tree.close();
+  unlink(INDEX_FILE);
+  unlink((std::string(INDEX_FILE) + ".hot").c_str());
+
+  printf("%d keys: %d missing after the inserts, %d after reopening\n", keyCount, missing,
+         missingReopened);
+  printf("%d threads in a pool of %d pages: %d missing, %d pins left, fewest pins on a page %d\n",
+         THREADS, POOL_PAGES, missingConcurrent, pins, fewest);
+  return (missing == 0 && missingReopened == 0 && missingConcurrent == 0 &&
+          pins == 0 && fewest == 0) ? 0 : 1;
+}
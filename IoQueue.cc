@@ -0,0 +1,284 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include "Bruinbase.h"
+#include "IoQueue.h"
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using std::deque;
+
+bool IoQueue::ringDisabled = false;
+
+//
+// the io_uring instance shared by all batches.
+// a batch holds ringLock from its first submission to its last completion.
+//
+static struct {
+  int       fd;        // the ring file descriptor. -1 if there is no ring
+  unsigned* sqTail;    // submission queue tail, advanced by us
+  unsigned* sqMask;
+  unsigned* sqArray;
+  struct io_uring_sqe* sqes;
+  unsigned* cqHead;    // completion queue head, advanced by us
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+} ring = { -1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+
+static bool ringTried = false;  // true once we tried to set up the ring
+static pthread_mutex_t ringLock = PTHREAD_MUTEX_INITIALIZER;
+
+// set up the ring. return true if io_uring is usable
+static bool setupRing();
+
+// read the request with pread()
+static void syncRead(IoQueue::Request& req);
+
+//
+// the fallback thread pool. each job is one request of a batch,
+// and a batch is done when its remaining count drops to zero.
+//
+struct Batch {
+  int remaining;  // # of requests of the batch not completed yet
+};
+
+struct Job {
+  IoQueue::Request* req;
+  Batch*            batch;
+};
+
+static deque<Job> jobs;          // the requests waiting for a thread
+static bool poolStarted = false; // true once the threads are created
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  jobCond  = PTHREAD_COND_INITIALIZER;  // a job was queued
+static pthread_cond_t  doneCond = PTHREAD_COND_INITIALIZER;  // a batch completed
+
+// the main loop of a pool thread
+static void* poolWorker(void* arg);
+
+
+RC IoQueue::readBatch(Request* reqs, int n, int* calls)
+{
+  int issued = 0;
+
+  if (calls != NULL) *calls = 0;
+  if (n <= 0) return 0;
+
+  // a single read gains nothing from being queued
+  if (n == 1) {
+    syncRead(reqs[0]);
+    issued = 1;
+  } else if (ringRead(reqs, n, issued) == RC_FILE_OPEN_FAILED) {
+    poolRead(reqs, n, issued);
+  }
+  if (calls != NULL) *calls = issued;
+
+  for (int i = 0; i < n; i++) {
+    if (reqs[i].result < 0) return RC_FILE_READ_FAILED;
+  }
+  return 0;
+}
+
+RC IoQueue::ringRead(Request* reqs, int n, int& calls)
+{
+  pthread_mutex_lock(&ringLock);
+
+  if (!ringTried) {
+    ringTried = true;
+    if (!ringDisabled) setupRing();
+  }
+  if (ring.fd < 0) {
+    pthread_mutex_unlock(&ringLock);
+    return RC_FILE_OPEN_FAILED;
+  }
+
+  int next = 0;      // the next request to queue
+  int done = 0;      // # of completed requests
+  int inflight = 0;  // # of requests queued but not completed
+  int pending = 0;   // # of requests queued but not consumed by the kernel
+
+  while (done < n) {
+    // queue as many requests as the ring has room for
+    unsigned tail = *ring.sqTail;
+    while (next < n && inflight < RING_ENTRIES) {
+      unsigned idx = tail & *ring.sqMask;
+      struct io_uring_sqe* sqe = &ring.sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = reqs[next].fd;
+      sqe->addr = (unsigned long) reqs[next].buffer;
+      sqe->len = reqs[next].length;
+      sqe->off = reqs[next].offset;
+      sqe->user_data = next;
+      ring.sqArray[idx] = idx;
+      tail++;
+      next++;
+      inflight++;
+      pending++;
+    }
+    __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+    // submit the new requests and wait for at least one completion
+    int ret = syscall(__NR_io_uring_enter, ring.fd, pending, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    calls++;
+    if (ret >= 0) {
+      pending -= ret;
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // the ring is broken. give up on it for good and
+      // read the whole batch again synchronously.
+      ::close(ring.fd);
+      ring.fd = -1;
+      for (int i = 0; i < n; i++) syncRead(reqs[i]);
+      calls += n;
+      pthread_mutex_unlock(&ringLock);
+      return RC_FILE_READ_FAILED;
+    }
+
+    // collect the completions, in whatever order they arrive
+    unsigned head = *ring.cqHead;
+    unsigned ctail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    while (head != ctail) {
+      struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+      Request& req = reqs[cqe->user_data];
+      req.result = cqe->res;
+
+      // retry a failed request synchronously to get a plain error code
+      if (req.result < 0) {
+        syncRead(req);
+        calls++;
+      }
+
+      head++;
+      done++;
+      inflight--;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&ringLock);
+  return 0;
+}
+
+RC IoQueue::poolRead(Request* reqs, int n, int& calls)
+{
+  Batch batch;
+  batch.remaining = n;
+  calls += n;  // every request is one pread()
+
+  pthread_mutex_lock(&poolLock);
+
+  // start the threads on first use
+  if (!poolStarted) {
+    for (int i = 0; i < THREAD_COUNT; i++) {
+      pthread_t tid;
+      if (pthread_create(&tid, NULL, poolWorker, NULL) == 0) {
+        pthread_detach(tid);
+        poolStarted = true;
+      }
+    }
+  }
+
+  // without any thread, read everything here
+  if (!poolStarted) {
+    pthread_mutex_unlock(&poolLock);
+    for (int i = 0; i < n; i++) syncRead(reqs[i]);
+    return 0;
+  }
+
+  for (int i = 0; i < n; i++) {
+    Job job = { &reqs[i], &batch };
+    jobs.push_back(job);
+  }
+  pthread_cond_broadcast(&jobCond);
+
+  while (batch.remaining > 0) pthread_cond_wait(&doneCond, &poolLock);
+
+  pthread_mutex_unlock(&poolLock);
+  return 0;
+}
+
+static void* poolWorker(void* /* arg */)
+{
+  pthread_mutex_lock(&poolLock);
+  for (;;) {
+    while (jobs.empty()) pthread_cond_wait(&jobCond, &poolLock);
+    Job job = jobs.front();
+    jobs.pop_front();
+
+    // issue the read without holding the lock
+    pthread_mutex_unlock(&poolLock);
+    syncRead(*job.req);
+    pthread_mutex_lock(&poolLock);
+
+    if (--job.batch->remaining == 0) pthread_cond_broadcast(&doneCond);
+  }
+  return NULL;
+}
+
+static void syncRead(IoQueue::Request& req)
+{
+  req.result = ::pread(req.fd, req.buffer, req.length, req.offset);
+}
+
+static bool setupRing()
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = syscall(__NR_io_uring_setup, IoQueue::RING_ENTRIES, &p);
+  if (fd < 0) return false;
+
+  // map the submission and completion rings and the submission entries.
+  // newer kernels let both rings share one mapping.
+  size_t sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && cqLen > sqLen) sqLen = cqLen;
+
+  void* sq = mmap(NULL, sqLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                  fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) { ::close(fd); return false; }
+
+  void* cq = sq;
+  if (!single) {
+    cq = mmap(NULL, cqLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+              fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) { munmap(sq, sqLen); ::close(fd); return false; }
+  }
+
+  size_t sqeLen = p.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, sqeLen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                    fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (!single) munmap(cq, cqLen);
+    munmap(sq, sqLen);
+    ::close(fd);
+    return false;
+  }
+
+  ring.sqTail  = (unsigned*) ((char*) sq + p.sq_off.tail);
+  ring.sqMask  = (unsigned*) ((char*) sq + p.sq_off.ring_mask);
+  ring.sqArray = (unsigned*) ((char*) sq + p.sq_off.array);
+  ring.sqes    = (struct io_uring_sqe*) sqes;
+  ring.cqHead  = (unsigned*) ((char*) cq + p.cq_off.head);
+  ring.cqTail  = (unsigned*) ((char*) cq + p.cq_off.tail);
+  ring.cqMask  = (unsigned*) ((char*) cq + p.cq_off.ring_mask);
+  ring.cqes    = (struct io_uring_cqe*) ((char*) cq + p.cq_off.cqes);
+  ring.fd = fd;
+
+  return true;
+}
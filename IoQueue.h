@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef IOQUEUE_H
+#define IOQUEUE_H
+
+#include <cstddef>
+#include <sys/types.h>
+#include "Bruinbase.h"
+
+/**
+ * issue a batch of reads at once and wait for all of them.
+ * the reads are submitted through io_uring when the kernel supports it,
+ * and handed to a small pool of threads issuing pread() otherwise.
+ * either way they are in flight together and complete in any order.
+ */
+class IoQueue {
+ public:
+
+  static const int RING_ENTRIES = 64;  // max # of reads in flight on io_uring
+  static const int THREAD_COUNT = 8;   // # of threads in the fallback pool
+
+  /**
+   * one read in a batch
+   */
+  struct Request {
+    int     fd;      // the file to read from
+    void*   buffer;  // the memory to read into
+    size_t  length;  // # of bytes to read
+    off_t   offset;  // the file offset to read from
+    ssize_t result;  // OUT: # of bytes read, or -1 on error
+  };
+
+  /**
+   * read all requests and wait until every one of them has completed.
+   * @param reqs[IN/OUT] the requests. their result fields are set
+   * @param n[IN] # of requests
+   * @param calls[OUT] if not NULL, receives the # of system calls issued
+   * @return error code. 0 if every read succeeded
+   */
+  static RC readBatch(Request* reqs, int n, int* calls = NULL);
+
+  /**
+   * do not use io_uring even if the kernel supports it.
+   * must be called before the first readBatch().
+   */
+  static void disableRing() { ringDisabled = true; }
+
+ private:
+  static bool ringDisabled;  // true if only the thread pool may be used
+
+  /**
+   * read the requests through io_uring.
+   * @param calls[OUT] incremented by the # of system calls issued
+   * @return error code. RC_FILE_OPEN_FAILED if io_uring is unavailable
+   *         and none of the requests was issued
+   */
+  static RC ringRead(Request* reqs, int n, int& calls);
+
+  /**
+   * read the requests with the thread pool.
+   * @param calls[OUT] incremented by the # of system calls issued
+   * @return error code. 0 if no error
+   */
+  static RC poolRead(Request* reqs, int n, int& calls);
+};
+
+#endif // IOQUEUE_H
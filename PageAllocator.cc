@@ -0,0 +1,193 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include "Bruinbase.h"
+#include "PageAllocator.h"
+#include <cstring>
+
+//
+// every map page starts with this header, followed by the bitmap of
+// the pages it covers. the n'th map page covers the pages from
+// n * mapBits on. like the nodes, the map numbers the pages of the
+// index in ints.
+//
+struct MapHeader {
+  int next;      // the next page of the map. -1 if this is the last one
+  int reserved;  // # of pages in reserved extents. only kept in the first page
+};
+
+PageAllocator::PageAllocator()
+{
+  file = NULL;
+  mapBits = 0;
+  reserved = 0;
+}
+
+RC PageAllocator::create(PageFile& pf, PageId& mapPid)
+{
+  if (pf.isReadOnly()) return RC_FILE_WRITE_FAILED;
+
+  file = &pf;
+  mapBits = (pf.getPageSize() - sizeof(MapHeader)) * 8;
+  mapPids.clear();
+  used.clear();
+
+  // the pages written so far are in use, and fill up whole extents
+  reserved = 0;
+  while (reserved < pf.endPid()) reserveExtent();
+  if (reserved == 0) reserveExtent();
+  for (PageId pid = 0; pid < pf.endPid(); pid++) used[pid / 8] |= 1 << (pid % 8);
+
+  // the map starts out with one page. take() adds more as needed.
+  mapPid = findFree(0);
+  if (mapPid < 0) mapPid = reserveExtent();
+  mapPids.push_back(mapPid);
+
+  RC rc = take(mapPid);
+  if (rc < 0) file = NULL;
+  return rc;
+}
+
+RC PageAllocator::open(PageFile& pf, PageId mapPid)
+{
+  RC rc;
+  char page[PageFile::MAX_PAGE_SIZE];
+  MapHeader header;
+
+  if (pf.isReadOnly()) return RC_FILE_WRITE_FAILED;
+
+  mapBits = (pf.getPageSize() - sizeof(MapHeader)) * 8;
+  mapPids.clear();
+  used.clear();
+  reserved = 0;
+
+  // follow the chain of map pages, collecting their bitmaps
+  for (PageId pid = mapPid; pid >= 0; pid = header.next) {
+    if ((PageId) mapPids.size() > pf.endPid()) return RC_INVALID_FILE_FORMAT;
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    memcpy(&header, page, sizeof(header));
+    if (mapPids.empty()) {
+      reserved = header.reserved;
+      if (reserved <= 0 || reserved % EXTENT_PAGES != 0) return RC_INVALID_FILE_FORMAT;
+      used.resize(reserved / 8, 0);
+    }
+
+    // copy the part of the bitmap that covers reserved pages
+    int first = mapPids.size() * mapBits / 8;
+    int bytes = (int) used.size() - first;
+    if (bytes > mapBits / 8) bytes = mapBits / 8;
+    if (bytes > 0) memcpy(&used[first], page + sizeof(header), bytes);
+    mapPids.push_back(pid);
+  }
+
+  file = &pf;
+  return 0;
+}
+
+RC PageAllocator::allocate(PageId near, PageId& pid)
+{
+  if (file == NULL) return RC_FILE_WRITE_FAILED;
+
+  if (near < 0 || near >= reserved) {
+    pid = reserveExtent();
+    return take(pid);
+  }
+
+  // try the extent of near, and then the extents its overflow went to
+  PageId extent = near - near % EXTENT_PAGES;
+  pid = findFree(near + 1 < extent + EXTENT_PAGES ? near + 1 : extent);
+  while (pid < 0 && overflow.find(extent) != overflow.end()) {
+    extent = overflow[extent];
+    pid = findFree(extent);
+  }
+  // then the newest extent, which is only partly used, before growing
+  // the file. the overflow is not kept across open(), so this is also
+  // where it goes after the file was reopened.
+  if (pid < 0 && (pid = findFree(reserved - EXTENT_PAGES)) < 0) {
+    pid = reserveExtent();
+  }
+  if (extent != pid - pid % EXTENT_PAGES) overflow[extent] = pid - pid % EXTENT_PAGES;
+  return take(pid);
+}
+
+RC PageAllocator::allocateExtent(PageId& pid)
+{
+  if (file == NULL) return RC_FILE_WRITE_FAILED;
+
+  pid = reserveExtent();
+  return take(pid);
+}
+
+PageId PageAllocator::findFree(PageId from) const
+{
+  PageId first = from - from % EXTENT_PAGES;
+  PageId end = first + EXTENT_PAGES;
+
+  // the pages after from keep a chain of neighbors in file order.
+  // those before it are only used once the rest of the extent is full.
+  for (PageId pid = from; pid < end; pid++) {
+    if (!isUsed(pid)) return pid;
+  }
+  for (PageId pid = first; pid < from; pid++) {
+    if (!isUsed(pid)) return pid;
+  }
+  return -1;
+}
+
+PageId PageAllocator::reserveExtent()
+{
+  PageId first = reserved;
+  reserved += EXTENT_PAGES;
+  used.resize(reserved / 8, 0);
+  return first;
+}
+
+RC PageAllocator::take(PageId pid)
+{
+  RC rc;
+
+  used[pid / 8] |= 1 << (pid % 8);
+
+  // extend the map until it covers every reserved page.
+  // a new map page goes near the last one.
+  while ((PageId) mapPids.size() * mapBits < reserved) {
+    PageId last = mapPids.back();
+    PageId next = findFree(last);
+    if (next < 0) next = reserveExtent();
+    used[next / 8] |= 1 << (next % 8);
+    mapPids.push_back(next);
+    if ((rc = writeMap(mapPids.size() - 2)) < 0) return rc;
+    if ((rc = writeMap(mapPids.size() - 1)) < 0) return rc;
+  }
+
+  // the first map page holds the # of reserved pages,
+  // and the page's own map page holds its bit
+  if ((rc = writeMap(0)) < 0) return rc;
+  int n = pid / mapBits;
+  if (n != 0 && (rc = writeMap(n)) < 0) return rc;
+  return 0;
+}
+
+RC PageAllocator::writeMap(int n)
+{
+  char page[PageFile::MAX_PAGE_SIZE];
+  MapHeader header;
+
+  memset(page, 0, file->getPageSize());
+  header.next = (n + 1 < (int) mapPids.size()) ? (int) mapPids[n + 1] : -1;
+  header.reserved = (n == 0) ? (int) reserved : 0;
+  memcpy(page, &header, sizeof(header));
+
+  int first = n * mapBits / 8;
+  int bytes = (int) used.size() - first;
+  if (bytes > mapBits / 8) bytes = mapBits / 8;
+  if (bytes > 0) memcpy(page + sizeof(header), &used[first], bytes);
+
+  return file->write(mapPids[n], page);
+}
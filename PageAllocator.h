@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef PAGEALLOCATOR_H
+#define PAGEALLOCATOR_H
+
+#include <map>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * allocate the pages of a PageFile in extents.
+ * the file grows by EXTENT_PAGES pages at a time, and a page can be
+ * placed near another one, in the same extent, while the extent has
+ * free pages. pages that belong together thus stay close in the file.
+ * the allocator keeps a free-space map, one bit per page, in a chain of
+ * map pages inside the file itself. every allocation writes the map
+ * page it changed, so the map is as durable as the pages allocated.
+ */
+class PageAllocator {
+ public:
+  static const int EXTENT_PAGES = 16;  // # of pages in an extent
+
+  PageAllocator();
+
+  /**
+   * start keeping a map for a file that has none yet. the pages below
+   * endPid() are taken to be in use, and the map goes into a page of
+   * the first extent with room.
+   * @param pf[IN] the file, opened in 'w' mode
+   * @param mapPid[OUT] the first page of the map, needed by open()
+   * @return error code. 0 if no error
+   */
+  RC create(PageFile& pf, PageId& mapPid);
+
+  /**
+   * load the map of a file.
+   * @param pf[IN] the file, opened in 'w' mode
+   * @param mapPid[IN] the first page of the map, as returned by create()
+   * @return error code. 0 if no error
+   */
+  RC open(PageFile& pf, PageId mapPid);
+
+  /**
+   * @return true if create() or open() succeeded
+   */
+  bool isOpen() const { return file != NULL; }
+
+  /**
+   * allocate a page, as close after near as possible, within the
+   * extent of near. if the extent is full, the page goes to the extent
+   * that took the overflow of the extent before, so that the pages
+   * placed near each other share as few extents as possible. only if
+   * that one is full too, the page starts a new extent.
+   * @param near[IN] the page to place the new page next to
+   * @param pid[OUT] the page allocated
+   * @return error code. 0 if no error
+   */
+  RC allocate(PageId near, PageId& pid);
+
+  /**
+   * allocate the first page of a new extent, leaving the rest of the
+   * extent to the pages that will be allocated near it.
+   * @param pid[OUT] the page allocated
+   * @return error code. 0 if no error
+   */
+  RC allocateExtent(PageId& pid);
+
+ private:
+  PageFile* file;               // the file whose pages are allocated
+  int       mapBits;            // # of pages covered by each map page
+  PageId    reserved;           // # of pages in the extents reserved so far
+  std::vector<PageId> mapPids;  // the pages of the map, in chain order
+  std::vector<unsigned char> used;  // one bit per reserved page. set if allocated
+  std::map<PageId, PageId> overflow; // the extent that takes the pages that do not
+                                     // fit in an extent, by their first pages
+
+  bool isUsed(PageId pid) const { return (used[pid / 8] >> (pid % 8)) & 1; }
+
+  /**
+   * @return the first free page at or after from in the extent of from,
+   *         wrapping around to the start of the extent. -1 if it is full
+   */
+  PageId findFree(PageId from) const;
+
+  /**
+   * reserve a new extent at the end of the file.
+   * @return the first page of the extent
+   */
+  PageId reserveExtent();
+
+  /**
+   * mark the page as allocated, extending the map if it does not
+   * cover all reserved pages, and write the map pages that changed.
+   * @return error code. 0 if no error
+   */
+  RC take(PageId pid);
+
+  /**
+   * write the n'th page of the map.
+   * @return error code. 0 if no error
+   */
+  RC writeMap(int n);
+};
+
+#endif // PAGEALLOCATOR_H
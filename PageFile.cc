@@ -9,28 +9,199 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "IoQueue.h"
+#include "PageTrace.h"
+#include "ReplacePolicy.h"
+#include "WriteAheadLog.h"
+#include <cassert>
+#include <cstdlib>
 #include <cstring>
+#include <climits>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
 
+using std::map;
 using std::string;
+using std::vector;
 
-int PageFile::readCount = 0;
-int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+IoStats PageFile::totals;
+
+int PageFile::defaultPageSize = PageFile::PAGE_SIZE;
+
+int PageFile::cacheCount = PageFile::DEFAULT_CACHE_COUNT;
+int PageFile::frameSize = 0;
+int PageFile::hashCount = 0;
+struct PageFile::cacheStruct* PageFile::readCache = NULL;
+int*  PageFile::hashTable = NULL;
+char* PageFile::cacheData = NULL;
+ReplacePolicy* PageFile::policy = NULL;
+string PageFile::policyName = "lru";
+bool  PageFile::writeBack = false;
+bool  PageFile::directIo = false;
+bool  PageFile::preallocate = false;
+bool  PageFile::hugePages = false;
+bool  PageFile::optimistic = true;
+const char* PageFile::poolMemory = "normal pages";
+size_t PageFile::poolMapped = 0;
+WriteAheadLog* PageFile::log = NULL;
+
+// cacheLock protects the buffer pool and the page counters.
+// cacheCond is signaled whenever a page finishes loading into a frame
+// or a frame is unpinned.
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cacheCond = PTHREAD_COND_INITIALIZER;
+
+// the version of the buffer pool as a whole. it is odd while the pool is
+// allocated or freed, and readers without the lock check it like the
+// versions of the frames.
+static unsigned poolVersion = 0;
+
+// set by allocFrame() before it looks for a frame that is not pinned,
+// so that the unpin() that makes one evictable signals cacheCond.
+// cleared by that unpin(), which takes the lock to signal.
+static bool unpinWanted = false;
+
+// once a hit was served without the lock, a pool that is replaced may
+// still be looked at by such a reader. its memory is then kept here
+// rather than freed. pools are only replaced when the cache is
+// configured, or when a file with larger pages is opened.
+static bool optimisticUsed = false;
+static vector<void*> retiredPools;
+
+//
+// files created by this version start with a header that occupies the
+// first page. legacy files have no header and use PAGE_SIZE pages.
+//
+static const int HEADER_MAGIC   = 0x46504242;  // "BBPF"
+static const int HEADER_VERSION = 1;
+
+struct FileHeader {
+  int magic;     // HEADER_MAGIC
+  int version;   // HEADER_VERSION
+  int pageSize;  // the size of every page in the file
+};
+
+//
+// the hot set of a file is saved in a file of its own: this header,
+// followed by the 64-bit page ids, from the coldest to the hottest page.
+// "BBHS" files held 32-bit page ids, and are ignored.
+//
+static const int HOT_MAGIC = 0x32484242;  // "BBH2"
+
+struct HotHeader {
+  int magic;  // HOT_MAGIC
+  int count;  // # of page ids that follow
+};
+
+// write the header to the first page of the file, and to the log
+// if the file is logged
+static RC writeHeader(int fd, const FileHeader& header, WriteAheadLog* log, int logFile);
+
+//
+// every unix file opened so far gets an id that names its pages in the
+// buffer pool. clean pages stay cached after the file is closed, and are
+// used again when the file is opened next, unless its size or modification
+// time shows that it was changed behind our back in the meantime.
+// the table is protected by cacheLock.
+//
+struct FileEntry {
+  dev_t  dev;       // the device of the file
+  ino_t  ino;       // the inode of the file
+  int    opens;     // # of PageFiles that have the file open
+  off_t  size;      // the size of the file when it was last closed
+  struct timespec mtime;  // the modification time when it was last closed
+  PageFile* writer; // the PageFile logging its writes to the file. NULL if none
+};
+static vector<FileEntry> fileTable;
+
+//
+// the pages written to logged files since their last checkpoint, and the
+// log offset of their latest content. a page missing from the pool is
+// read from the log if it is here. protected by cacheLock.
+//
+typedef std::pair<int, PageId> PageKey;  // (file id, pid)
+static map<PageKey, off_t> loggedPages;
+
+//
+// the trace of the page accesses, if one is being written. the records
+// are collected in traceBuffer, and written out when it is full and when
+// the trace ends. tracing is looked at without the lock, so that there is
+// nothing to wait for when there is no trace. the rest is protected by
+// traceLock, which may be taken while cacheLock is held, but not the
+// other way around. a trace that cannot be written stops, and the error
+// is reported when it is ended.
+//
+static const size_t TRACE_BUFFER_SIZE = 1 << 16;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static bool tracing = false;
+static int  traceFd = -1;
+static bool traceFailed = false;
+static vector<char> traceBuffer;
+static long long traceLast;      // the time of the last record, in microseconds
+static vector<bool> traceNamed;  // true for the file ids named in the trace
+
+//
+// the space reserved for growing files (allocEnd) is changed under
+// growLock. it is never taken while cacheLock is held, so that the pool
+// does not wait for a fallocate(). a write looks at allocEnd without
+// the lock first, and only takes it to reserve more space.
+//
+static pthread_mutex_t growLock = PTHREAD_MUTEX_INITIALIZER;
+
+// @return the current time in microseconds since the epoch
+static long long traceTime();
+
+// append the data to the trace, writing it out if the buffer is full
+static void appendTrace(const void* data, size_t length);
+
+// write the buffered records to the trace file
+static RC writeTrace();
 
 PageFile::PageFile() 
 { 
   fd = -1; 
+  fileId = -1;
   epid = 0; 
+  raLast = -1;
+  raNext = 0;
+  raWindow = READ_AHEAD_MIN;
+  readOnly = false;
+  direct = false;
+  pageSize = PAGE_SIZE;
+  dataOffset = 0;
+  mapAddr = NULL;
+  touched = NULL;
+  allocEnd = -1;
+  logFile = -1;
+  prefetching = false;
 }
 
 PageFile::PageFile(const string& filename, char mode)
 {
   fd = -1;
+  fileId = -1;
   epid = 0;
+  raLast = -1;
+  raNext = 0;
+  raWindow = READ_AHEAD_MIN;
+  readOnly = false;
+  direct = false;
+  pageSize = PAGE_SIZE;
+  dataOffset = 0;
+  mapAddr = NULL;
+  touched = NULL;
+  allocEnd = -1;
+  logFile = -1;
+  prefetching = false;
   open(filename.c_str(), mode);
 }
 
@@ -39,9 +210,12 @@ RC PageFile::open(const string& filename, char mode)
   RC   rc;
   int  oflag;
   struct stat statbuf;
+  FileHeader  header;
 
   if (fd > 0) return RC_FILE_OPEN_FAILED;
 
+  stats.clear();
+
   // set the unix file flag depending on the file mode
   switch (mode) {
   case 'r':
@@ -52,6 +226,10 @@ RC PageFile::open(const string& filename, char mode)
   case 'W':
     oflag = (O_RDWR|O_CREAT);
     break;
+  case 'm':
+  case 'M':
+    oflag = O_RDONLY;
+    break;
   default:
     return RC_INVALID_FILE_MODE;
   }
@@ -59,11 +237,132 @@ RC PageFile::open(const string& filename, char mode)
   // open the file
   fd = ::open(filename.c_str(), oflag, 0644);
   if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
+  name = filename;
 
   // get the size of the file to set the end pid
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
-  epid = statbuf.st_size / PAGE_SIZE;
+  readOnly = (oflag == O_RDONLY);
+
+  //
+  // find out the page size of the file. a new file gets the default
+  // page size and a header recording it. a file without the header
+  // is a legacy file with PAGE_SIZE pages.
+  //
+  pageSize = PAGE_SIZE;
+  dataOffset = 0;
+  bool created = false;  // true if the header of a new file is to be written
+  if (statbuf.st_size == 0) {
+    if (!readOnly) {
+      created = true;
+      pageSize = defaultPageSize;
+      dataOffset = pageSize;
+    }
+  } else {
+    count(&IoStats::syscalls, 1);
+    if (::pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == HEADER_MAGIC) {
+      if (header.version != HEADER_VERSION || !validPageSize(header.pageSize)) {
+        ::close(fd); fd = -1; return RC_INVALID_FILE_FORMAT;
+      }
+      pageSize = header.pageSize;
+      dataOffset = pageSize;
+    }
+  }
+
+  // make sure the pages of the file fit in the cache frames
+  if ((rc = growFrames(pageSize)) < 0) { ::close(fd); fd = -1; return rc; }
+
+  // get the size of the file to set the end pid
+  if (statbuf.st_size > dataOffset) epid = (statbuf.st_size - dataOffset) / pageSize;
+  else epid = 0;
+
+  // in 'm' mode, map the whole file and serve every read from the mapping
+  if ((mode == 'm' || mode == 'M') && epid > 0) {
+    void* addr = ::mmap(NULL, dataOffset + (size_t) epid * pageSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) { ::close(fd); fd = -1; epid = 0; return RC_FILE_OPEN_FAILED; }
+
+    // one bit per page to count the distinct pages that are read
+    touched = (unsigned char*) calloc(epid / 8 + 1, 1);
+    if (touched == NULL) {
+      ::munmap(addr, dataOffset + (size_t) epid * pageSize);
+      ::close(fd); fd = -1; epid = 0; return RC_OUT_OF_MEMORY;
+    }
+    mapAddr = (char*) addr;
+  }
+
+  //
+  // nothing can fail from here on but the header of a new file, which
+  // is written before the file is known to the log or the buffer pool.
+  // a file opened for writing is logged if there is a log.
+  //
+  logFile = -1;
+  if (!readOnly && log != NULL) {
+    pthread_mutex_lock(&cacheLock);
+    logFile = log->addFile(filename);
+    pthread_mutex_unlock(&cacheLock);
+  }
+  if (created) {
+    memset(&header, 0, sizeof(header));
+    header.magic = HEADER_MAGIC;
+    header.version = HEADER_VERSION;
+    header.pageSize = pageSize;
+    count(&IoStats::syscalls, 1);
+    pthread_mutex_lock(&cacheLock);
+    rc = writeHeader(fd, header, log, logFile);
+    pthread_mutex_unlock(&cacheLock);
+    if (rc < 0) {
+      ::close(fd); fd = -1; logFile = -1; return RC_FILE_WRITE_FAILED;
+    }
+    count(&IoStats::bytesWritten, pageSize);
+  }
+
+  // a direct file bypasses the kernel page cache from here on.
+  // the header was read and written through it, as it is not aligned.
+  direct = false;
+  if (directIo && mode != 'm' && mode != 'M') enableDirect();
+
+  // find the pages of the file that are still cached from its last use
+  bool cold = true;  // true if none of them can be
+  pthread_mutex_lock(&cacheLock);
+  for (fileId = 0; fileId < (int) fileTable.size(); fileId++) {
+    if (fileTable[fileId].dev == statbuf.st_dev &&
+        fileTable[fileId].ino == statbuf.st_ino) break;
+  }
+  if (fileId == (int) fileTable.size()) {
+    FileEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.dev = statbuf.st_dev;
+    entry.ino = statbuf.st_ino;
+    entry.size = -1;
+    entry.writer = NULL;
+    fileTable.push_back(entry);
+  } else if (fileTable[fileId].opens == 0 &&
+             (fileTable[fileId].size != statbuf.st_size ||
+              fileTable[fileId].mtime.tv_sec != statbuf.st_mtim.tv_sec ||
+              fileTable[fileId].mtime.tv_nsec != statbuf.st_mtim.tv_nsec)) {
+    // the file changed since we closed it. its cached pages are stale.
+    for (int i = 0; readCache != NULL && i < cacheCount; i++) {
+      if (readCache[i].valid && readCache[i].fileId == fileId) dropFrame(i);
+    }
+  } else {
+    cold = false;
+  }
+  fileTable[fileId].opens++;
+  if (logFile >= 0) fileTable[fileId].writer = this;
+  pthread_mutex_unlock(&cacheLock);
+
+  // a file being written starts out with no space reserved past its end,
+  // except what an earlier open that was not closed may have left behind
+  allocEnd = -1;
+  if (!readOnly && preallocate) {
+    allocEnd = (off_t) statbuf.st_blocks * 512;
+    if (allocEnd < statbuf.st_size) allocEnd = statbuf.st_size;
+  }
+
+  // warm up the pool with the pages that were hot when the file was
+  // last closed, unless it is still warm from then
+  if (cold && mode != 'm' && mode != 'M' && epid > 0) loadHotSet();
 
   return 0;
 }
@@ -72,21 +371,60 @@ RC PageFile::close()
 {
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
-  // close the file
-  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
+  // the hot set may still be being read through the file
+  if (prefetching) {
+    pthread_join(prefetcher, NULL);
+    prefetching = false;
+  }
+
+  // write back the dirty pages before the file goes away
+  if (flush() < 0) return RC_FILE_WRITE_FAILED;
+
+  // the file is complete, so it no longer needs the space past its end
+  pthread_mutex_lock(&growLock);
+  trim();
+  pthread_mutex_unlock(&growLock);
 
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
+  // unmap the file if it was opened in 'm' mode
+  bool pooled = (mapAddr == NULL);  // true if the file was read through the pool
+  if (mapAddr != NULL) {
+    ::munmap(mapAddr, dataOffset + (size_t) epid * pageSize);
+    free(touched);
+    mapAddr = NULL;
+    touched = NULL;
+  }
+
+  // the cached pages of the file stay in the pool. remember the state
+  // of the file to tell whether they are still good when it is reopened.
+  struct stat statbuf;
+  pthread_mutex_lock(&cacheLock);
+  for (int i = 0; readCache != NULL && i < cacheCount; i++) {
+    if (readCache[i].file == this) readCache[i].file = NULL;
+  }
+  FileEntry& entry = fileTable[fileId];
+  if (entry.writer == this) entry.writer = NULL;
+  bool last = (--entry.opens == 0);
+  if (last) {
+    if (::fstat(fd, &statbuf) == 0) {
+      entry.size = statbuf.st_size;
+      entry.mtime = statbuf.st_mtim;
+    } else {
+      entry.size = -1;
     }
   }
+  pthread_mutex_unlock(&cacheLock);
+
+  if (last && pooled) saveHotSet();
+
+  // close the file
+  if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
   // set the fd and epid to the initial state
   fd = -1; 
   epid = 0;
+  allocEnd = -1;
+  logFile = -1;
+  direct = false;
   return 0;
 }
 
@@ -95,86 +433,1445 @@ PageId PageFile::endPid() const
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+RC PageFile::setDefaultPageSize(int size)
+{
+  if (!validPageSize(size)) return RC_INVALID_ATTRIBUTE;
+  defaultPageSize = size;
+  return 0;
+}
+
+bool PageFile::enableDirect()
+{
+  // the file offsets of the pages and the frames they are read into must
+  // be aligned as the file system requires. where statx() cannot tell,
+  // assume the traditional 512 bytes.
+  unsigned memAlign = 512, offsetAlign = 512;
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+  if (::statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+      (stx.stx_mask & STATX_DIOALIGN)) {
+    if (stx.stx_dio_offset_align == 0) return false;  // no direct I/O at all
+    memAlign = stx.stx_dio_mem_align;
+    offsetAlign = stx.stx_dio_offset_align;
+  }
+#endif
+
+  // the pages start at multiples of the page size, and every frame is
+  // aligned to the page size or POOL_ALIGN, whichever is smaller
+  if (pageSize % offsetAlign != 0 || memAlign > (unsigned) pageSize ||
+      memAlign > (unsigned) POOL_ALIGN) return false;
+
+  int flags = ::fcntl(fd, F_GETFL);
+  if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_DIRECT) < 0) return false;
+  direct = true;
+  return true;
+}
+
+void PageFile::reserve(PageId pid)
+{
+  off_t end = pageOffset(pid + 1);
+
+  // most writes go to space that is reserved already
+  off_t reserved = __atomic_load_n(&allocEnd, __ATOMIC_ACQUIRE);
+  if (reserved < 0 || end <= reserved) return;
+
+  pthread_mutex_lock(&growLock);
+  if (allocEnd < 0 || end <= allocEnd) {
+    pthread_mutex_unlock(&growLock);
+    return;
+  }
+
+#ifdef FALLOC_FL_KEEP_SIZE
+  // double the reserved space each time, up to GROW_MAX at a time, so
+  // that a file takes few extensions, each in a run of its own
+  off_t chunk = allocEnd;
+  if (chunk < GROW_MIN) chunk = GROW_MIN;
+  if (chunk > GROW_MAX) chunk = GROW_MAX;
+  off_t newEnd = allocEnd + chunk;
+  if (newEnd < end) newEnd = end;
+  newEnd = (newEnd + GROW_MIN - 1) / GROW_MIN * GROW_MIN;
+
+  // a page written far past the end leaves a hole, which is not filled
+  off_t from = pageOffset(pid);
+  if (from < allocEnd) from = allocEnd;
+
+  // the size of the file stays at its logical end, so that a crash
+  // before trim() does not leave pages of zeros in it
+  count(&IoStats::syscalls, 1);
+  if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, from, newEnd - from) == 0) {
+    __atomic_store_n(&allocEnd, newEnd, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&growLock);
+    return;
+  }
+
+  // a failed fallocate() may keep part of the space it took
+  allocEnd = newEnd;
+  trim();
+#endif
+
+  // the file system cannot preallocate, or is full. the writes find out
+  // which, and the file grows as they go.
+  __atomic_store_n(&allocEnd, (off_t) -1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&growLock);
+}
+
+void PageFile::trim()
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  struct stat statbuf;
+  if (allocEnd < 0 || ::fstat(fd, &statbuf) < 0) return;
+
+  // the pages written may end before the space reserved for them.
+  // truncating to the same size drops the blocks past the end, which a
+  // hole punched there would leave alone on some file systems.
+  if (allocEnd > statbuf.st_size) {
+    count(&IoStats::syscalls, 1);
+    if (::ftruncate(fd, statbuf.st_size) < 0) return;
+  }
+  __atomic_store_n(&allocEnd, statbuf.st_size, __ATOMIC_RELEASE);
+}
+
+bool PageFile::validPageSize(int size)
+{
+  // a power of two between PAGE_SIZE and MAX_PAGE_SIZE
+  return size >= PAGE_SIZE && size <= MAX_PAGE_SIZE && (size & (size - 1)) == 0;
+}
+
+static RC writeHeader(int fd, const FileHeader& header, WriteAheadLog* log, int logFile)
+{
+  // the header takes up a whole page so that the pages stay aligned
+  char* page = (char*) calloc(header.pageSize, 1);
+  memcpy(page, &header, sizeof(header));
+  ssize_t n = ::pwrite(fd, page, header.pageSize, 0);
+
+  // the header is not synced with the file. recovery recreates it from the log.
+  off_t at = 0;
+  if (logFile >= 0) at = log->append(logFile, 0, page, header.pageSize);
+  free(page);
+
+  return (n == header.pageSize && at >= 0) ? 0 : RC_FILE_WRITE_FAILED;
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
+  RC rc = 0;
   if (pid < 0) return RC_INVALID_PID; 
+  if (readOnly) return RC_FILE_WRITE_FAILED;
+  trace(pid, TRACE_WRITE);
+
+  // a page past the end makes the file grow, into space reserved ahead.
+  // the space is reserved before the cache lock is taken.
+  reserve(pid);
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+  pthread_mutex_lock(&cacheLock);
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  // wait until any read of the page in progress has finished
+  int frame;
+  while ((frame = findFrame(fileId, pid)) >= 0 && readCache[frame].loading) {
+    pthread_cond_wait(&cacheCond, &cacheLock);
+  }
 
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
+  if (writeBack || logFile >= 0 || direct) {
+    // append a logged page to the log. it can be read back from there
+    // once it is evicted, and reaches the file at the next checkpoint.
+    if (logFile >= 0) {
+      off_t at = log->append(logFile, pageOffset(pid), buffer, pageSize,
+                             findLogged(fileId, pid));
+      if (at < 0) {
+        pthread_mutex_unlock(&cacheLock);
+        return RC_FILE_WRITE_FAILED;
+      }
+      loggedPages[PageKey(fileId, pid)] = at;
+    }
+
+    // keep the page in the cache and write it to the disk later.
+    // if every frame is busy, wait for one and look for the page again.
+    while (frame < 0) {
+      if ((frame = allocFrame(this)) >= 0) {
+        mapFrame(frame, this, pid);
+        break;
+      }
+      if (frame == -1) {
+        pthread_mutex_unlock(&cacheLock);
+        return RC_FILE_WRITE_FAILED;
+      }
+      do {
+        pthread_cond_wait(&cacheCond, &cacheLock);
+      } while ((frame = findFrame(fileId, pid)) >= 0 && readCache[frame].loading);
+    }
+    beginChange(frame);
+    memcpy(readCache[frame].buffer, buffer, pageSize);
+    endChange(frame);
+    readCache[frame].file = this;  // the file to write the page through
+    readCache[frame].dirty = true;
+    touchFrame(frame);
+
+    // a direct file is written through from its frame, which is aligned
+    if (!writeBack && logFile < 0) rc = flushRun(frame);
+  } else {
+    // write the buffer to the disk page
+    count(&IoStats::syscalls, 1);
+    if (::pwrite(fd, buffer, pageSize, pageOffset(pid)) < 0) {
+      rc = RC_FILE_WRITE_FAILED;
+    } else {
+      // if the page is in the cache, bring the cached copy up to date
+      if (frame >= 0) {
+        beginChange(frame);
+        memcpy(readCache[frame].buffer, buffer, pageSize);
+        endChange(frame);
+        touchFrame(frame);
+      }
+
+      // increase page write count
+      count(&IoStats::pageWrites, 1);
+      count(&IoStats::bytesWritten, pageSize);
     }
   }
 
   // if the written pid >= end pid, update the end pid
-  if (pid >= epid) epid = pid + 1;
+  if (rc == 0 && pid >= epid) epid = pid + 1;
 
-  // increase page write count
-  writeCount++;
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
 
-  return 0;
+RC PageFile::flush()
+{
+  RC rc = 0;
+
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+
+  pthread_mutex_lock(&cacheLock);
+  if (readCache != NULL) rc = flushFile(fileId);
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
 }
 
 RC PageFile::read(PageId pid, void* buffer) const
 {
-  RC rc;
+  int frame;
+  const char* page;
+
+  trace(pid, TRACE_READ);
+
+  // a mapped file is read straight from the mapping without the cache
+  if (mapAddr != NULL) {
+    if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+    memcpy(buffer, mapAddr + pageOffset(pid), pageSize);
+    count(&IoStats::bytesCopied, pageSize);
+    touchMapped(pid);
+    readAheadMapped(pid);
+    return 0;
+  }
+
+  // a hit needs no lock
+  if (readOptimistic(pid, buffer, page)) return 0;
+
+  pthread_mutex_lock(&cacheLock);
+
+  if ((frame = fetchFrame(pid)) < 0) {
+    pthread_mutex_unlock(&cacheLock);
+    return frame;
+  }
+  memcpy(buffer, readCache[frame].buffer, pageSize);
+  count(&IoStats::bytesCopied, pageSize);
+
+  pthread_mutex_unlock(&cacheLock);
+  return 0;
+}
+
+RC PageFile::pin(PageId pid, const char*& page) const
+{
+  int frame;
+
+  trace(pid, TRACE_READ);
+
+  // a mapped page stays put until the file is closed
+  if (mapAddr != NULL) {
+    if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+    page = mapAddr + pageOffset(pid);
+    touchMapped(pid);
+    readAheadMapped(pid);
+    return 0;
+  }
+
+  // a hit needs no lock
+  if (readOptimistic(pid, NULL, page)) return 0;
+
+  pthread_mutex_lock(&cacheLock);
+
+  if ((frame = fetchFrame(pid)) < 0) {
+    pthread_mutex_unlock(&cacheLock);
+    return frame;
+  }
+  __atomic_add_fetch(&readCache[frame].pins, 1, __ATOMIC_SEQ_CST);
+  page = readCache[frame].buffer;
+
+  pthread_mutex_unlock(&cacheLock);
+  return 0;
+}
+
+void PageFile::unpin(PageId pid) const
+{
+  int frame;
+
+  if (mapAddr != NULL) return;
+
+  //
+  // a pinned frame stays where it is, and the pool is not replaced while
+  // it is pinned, so the frame is usually found without the lock. the
+  // hash chains may change under the search though, and then the lock
+  // is taken to find it.
+  //
+  frame = -1;
+  int steps = 0;
+  for (int i = __atomic_load_n(&hashTable[hashPage(fileId, pid)], __ATOMIC_RELAXED);
+       i >= 0 && steps < cacheCount;
+       i = __atomic_load_n(&readCache[i].hashNext, __ATOMIC_RELAXED), steps++) {
+    if (__atomic_load_n(&readCache[i].fileId, __ATOMIC_RELAXED) == fileId &&
+        __atomic_load_n(&readCache[i].pid, __ATOMIC_RELAXED) == pid) {
+      frame = i;
+      break;
+    }
+  }
+  if (frame < 0 || __atomic_load_n(&readCache[frame].pins, __ATOMIC_RELAXED) == 0) {
+    pthread_mutex_lock(&cacheLock);
+    frame = findFrame(fileId, pid);
+    pthread_mutex_unlock(&cacheLock);
+  }
+
+  // a frame that is no longer pinned may be evicted again
+  if (frame >= 0 && __atomic_load_n(&readCache[frame].pins, __ATOMIC_RELAXED) > 0) {
+    releasePin(readCache[frame]);
+  }
+}
+
+bool PageFile::readOptimistic(PageId pid, void* buffer, const char*& page) const
+{
+  if (!optimistic || pid < 0 || pid >= epid) return false;
+
+  // a pool replaced from now on is kept, as we may be looking at it
+  if (!__atomic_load_n(&optimisticUsed, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&optimisticUsed, true, __ATOMIC_SEQ_CST);
+  }
+
+  // take a consistent look at the pool
+  unsigned pool = __atomic_load_n(&poolVersion, __ATOMIC_SEQ_CST);
+  cacheStruct* frames = __atomic_load_n(&readCache, __ATOMIC_RELAXED);
+  int* table = __atomic_load_n(&hashTable, __ATOMIC_RELAXED);
+  int buckets = __atomic_load_n(&hashCount, __ATOMIC_RELAXED);
+  int frameCount = __atomic_load_n(&cacheCount, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if ((pool & 1) || frames == NULL ||
+      __atomic_load_n(&poolVersion, __ATOMIC_RELAXED) != pool) return false;
+
+  // the chains may change while we follow them. then the page may be
+  // missed, and is looked up again with the lock.
+  int steps = 0;
+  for (int i = __atomic_load_n(&table[hashPage(fileId, pid, buckets)], __ATOMIC_RELAXED);
+       i >= 0 && i < frameCount && steps < frameCount;
+       i = __atomic_load_n(&frames[i].hashNext, __ATOMIC_RELAXED), steps++) {
+    cacheStruct& f = frames[i];
+    unsigned version = __atomic_load_n(&f.version, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&f.fileId, __ATOMIC_RELAXED) != fileId ||
+        __atomic_load_n(&f.pid, __ATOMIC_RELAXED) != pid) continue;
+
+    // the page is loading or being changed. the lock waits for it.
+    if (version & 1) return false;
+
+    if (buffer != NULL) {
+      // the copy only counts if the frame did not change during it
+      memcpy(buffer, f.buffer, pageSize);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&f.version, __ATOMIC_RELAXED) != version ||
+          __atomic_load_n(&poolVersion, __ATOMIC_RELAXED) != pool) return false;
+      count(&IoStats::bytesCopied, pageSize);
+    } else {
+      // the pin only holds if no eviction of the frame began before it.
+      // an eviction makes the frame odd before it checks the pins.
+      __atomic_add_fetch(&f.pins, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&f.version, __ATOMIC_SEQ_CST) != version ||
+          __atomic_load_n(&poolVersion, __ATOMIC_SEQ_CST) != pool) {
+        releasePin(f);
+        return false;
+      }
+      page = f.buffer;
+    }
+
+    // the replacement policy hears of the hit when the frame comes up
+    // for eviction. a hit continues a sequential scan as a miss does.
+    if (!__atomic_load_n(&f.referenced, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&f.referenced, true, __ATOMIC_RELAXED);
+    }
+    if (pid == __atomic_load_n(&raLast, __ATOMIC_RELAXED) + 1) {
+      __atomic_store_n(&raLast, pid, __ATOMIC_RELAXED);
+    }
+    count(&IoStats::hits, 1);
+    return true;
+  }
+  return false;
+}
+
+void PageFile::touchMapped(PageId pid) const
+{
+  // a mapped page counts as a page read the first time it is touched
+  unsigned char bit = 1 << (pid % 8);
+  if ((__sync_fetch_and_or(&touched[pid / 8], bit) & bit) == 0) {
+    count(&IoStats::pageReads, 1);
+    count(&IoStats::bytesRead, pageSize);
+  }
+}
+
+int PageFile::fetchFrame(PageId pid) const
+{
+  int frame;
 
   if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
 
+  // watch for a sequential scan of the file. rereading the same page,
+  // as a scan does for every tuple in it, does not break the sequence.
+  // hits served without the lock update raLast as well.
+  PageId last = __atomic_exchange_n(&raLast, pid, __ATOMIC_RELAXED);
+  bool sequential = (pid == last + 1);
+  if (pid != last && !sequential) raWindow = READ_AHEAD_MIN;
+
   //
-  // if the page is in cache, read it from there
+  // if the page is in cache, use the cached copy.
+  // if another thread is still loading it, wait for that read to finish.
   //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
+  for (;;) {
+    while ((frame = findFrame(fileId, pid)) >= 0) {
+      if (!readCache[frame].loading) {
+        touchFrame(frame);
+        count(&IoStats::hits, 1);
+        return frame;
+      }
+      pthread_cond_wait(&cacheCond, &cacheLock);
     }
+
+    // the replacement policy picks the frame to evict.
+    // if every frame is busy, wait for one and look for the page again.
+    if ((frame = allocFrame(this)) >= 0) break;
+    if (frame == -1) return RC_FILE_WRITE_FAILED;
+    pthread_cond_wait(&cacheCond, &cacheLock);
   }
+  count(&IoStats::misses, 1);
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
+  // claim the frame for the page
+  int frames[READ_AHEAD_MAX];
+  int pages = 1;
+  frames[0] = frame;
+  mapFrame(frame, this, pid);
+
+  // a page written since the last checkpoint is only up to date in the log
+  off_t at = findLogged(fileId, pid);
+  if (at >= 0) {
+    RC rc = readLogged(frame, at);
+    if (rc < 0) return rc;
+    endChange(frame);
+    return frame;
+  }
+  readCache[frame].loading = true;
+
+  //
+  // in a sequential scan, also claim frames for the pages that follow,
+  // up to the first one that is cached, so that they are all read with
+  // one system call. the window doubles with every read-ahead, but never
+  // takes more than a quarter of the pool.
+  //
+  if (sequential) {
+    int limit = (raWindow < cacheCount / 4) ? raWindow : cacheCount / 4;
+    while (pages < limit && pid + pages < epid && findFrame(fileId, pid + pages) < 0 &&
+           findLogged(fileId, pid + pages) < 0) {
+      int f = allocFrame(this);
+      if (f < 0) break;
+      mapFrame(f, this, pid + pages, true);
+      readCache[f].loading = true;
+      frames[pages++] = f;
     }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+    if (raWindow < READ_AHEAD_MAX) raWindow *= 2;
+  }
+
+  // read the pages without holding the lock,
+  // so that other threads can use the cache while we wait for the disk
+  pthread_mutex_unlock(&cacheLock);
+
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  ssize_t n;
+  if (pages == 1) {
+    n = ::pread(fd, readCache[frame].buffer, pageSize, pageOffset(pid));
+  } else {
+    struct iovec iov[READ_AHEAD_MAX];
+    for (int i = 0; i < pages; i++) {
+      iov[i].iov_base = readCache[frames[i]].buffer;
+      iov[i].iov_len = pageSize;
     }
+    n = ::preadv(fd, iov, pages, pageOffset(pid));
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
+  countLatency(begin);
+  count(&IoStats::syscalls, 1);
+
+  pthread_mutex_lock(&cacheLock);
+  for (int i = 0; i < pages; i++) readCache[frames[i]].loading = false;
+  pthread_cond_broadcast(&cacheCond);
+  if (n < 0) {
+    for (int i = 0; i < pages; i++) dropFrame(frames[i]);
     return RC_FILE_READ_FAILED;
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
+
+  // a page that has not reached the disk yet reads as zeros.
+  // the pages are complete now, and can be read without the lock.
+  for (int i = 0; i < pages; i++) {
+    ssize_t got = n - (ssize_t) i * pageSize;
+    if (got < 0) got = 0;
+    if (got < pageSize) memset(readCache[frames[i]].buffer + got, 0, pageSize - got);
+    endChange(frames[i]);
+  }
 
   // increase the page read count
-  readCount++;
+  count(&IoStats::pageReads, pages);
+  count(&IoStats::bytesRead, n);
+
+  return frame;
+}
+
+void PageFile::readAheadMapped(PageId pid) const
+{
+  // the same sequence detection as for cached reads. threads reading
+  // the same mapping may race on it, which only affects the hints.
+  PageId last = __atomic_exchange_n(&raLast, pid, __ATOMIC_RELAXED);
+  if (pid == last) return;
+  if (pid != last + 1) {
+    __atomic_store_n(&raWindow, READ_AHEAD_MIN, __ATOMIC_RELAXED);
+    return;
+  }
+  if (pid < __atomic_load_n(&raNext, __ATOMIC_RELAXED)) return;
+
+  // ask the kernel to start reading the next window of the mapping
+  int window = __atomic_load_n(&raWindow, __ATOMIC_RELAXED);
+  PageId end = (pid + window < epid) ? pid + window : epid;
+  size_t osPage = sysconf(_SC_PAGESIZE);
+  size_t begin = pageOffset(pid) & ~(osPage - 1);
+  ::madvise(mapAddr + begin, pageOffset(end) - begin, MADV_WILLNEED);
+  count(&IoStats::syscalls, 1);
+
+  __atomic_store_n(&raNext, end, __ATOMIC_RELAXED);
+  if (window < READ_AHEAD_MAX) __atomic_store_n(&raWindow, 2 * window, __ATOMIC_RELAXED);
+}
+
+RC PageFile::readMany(const PageId* pids, int n, void** buffers) const
+{
+  RC rc = 0;
+  vector<IoQueue::Request> reqs;  // the disk reads to issue together
+  vector<int> pos;                // the position in pids of each disk read
+  vector<int> later;              // the pages to read one by one afterwards
+  int frame;
+
+  // a mapped file has nothing to gain from batching
+  if (mapAddr != NULL) {
+    for (int i = 0; i < n; i++) {
+      if ((rc = read(pids[i], buffers[i])) < 0) return rc;
+    }
+    return 0;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+
+  for (int i = 0; i < n; i++) {
+    if (pids[i] < 0 || pids[i] >= epid) {
+      pthread_mutex_unlock(&cacheLock);
+      return RC_INVALID_PID;
+    }
+
+    // copy the cached pages right away. the pages that are being loaded,
+    // by this batch or by another thread, are read once that is done.
+    // a prefetch leaves both alone.
+    if ((frame = findFrame(fileId, pids[i])) >= 0) {
+      if (buffers == NULL) continue;
+      if (readCache[frame].loading) {
+        later.push_back(i);
+      } else {
+        trace(pids[i], TRACE_READ);
+        memcpy(buffers[i], readCache[frame].buffer, pageSize);
+        count(&IoStats::bytesCopied, pageSize);
+        touchFrame(frame);
+        count(&IoStats::hits, 1);
+      }
+      continue;
+    }
+
+    // claim a frame for the page. if every frame is busy, read it later.
+    if ((frame = allocFrame(this)) == -2) {
+      if (buffers != NULL) later.push_back(i);
+      continue;
+    }
+    if (frame < 0) { rc = RC_FILE_WRITE_FAILED; break; }
+    mapFrame(frame, this, pids[i], buffers == NULL);
+    if (buffers != NULL) {
+      trace(pids[i], TRACE_READ);
+      count(&IoStats::misses, 1);
+    }
+
+    // a logged page is read from the log right away
+    off_t at = findLogged(fileId, pids[i]);
+    if (at >= 0) {
+      if ((rc = readLogged(frame, at)) < 0) break;
+      endChange(frame);
+      if (buffers != NULL) {
+        memcpy(buffers[i], readCache[frame].buffer, pageSize);
+        count(&IoStats::bytesCopied, pageSize);
+      }
+      continue;
+    }
+    readCache[frame].loading = true;
+
+    IoQueue::Request req;
+    req.fd = fd;
+    req.buffer = readCache[frame].buffer;
+    req.length = pageSize;
+    req.offset = pageOffset(pids[i]);
+    req.result = -1;
+    reqs.push_back(req);
+    pos.push_back(i);
+  }
+
+  // issue all the disk reads at once without holding the lock
+  pthread_mutex_unlock(&cacheLock);
+  if (!reqs.empty()) {
+    struct timespec begin;
+    int calls = 0;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    IoQueue::readBatch(&reqs[0], reqs.size(), &calls);
+    countLatency(begin);
+    count(&IoStats::syscalls, calls);
+  }
+  pthread_mutex_lock(&cacheLock);
+
+  for (unsigned j = 0; j < reqs.size(); j++) {
+    int i = pos[j];
+    frame = findFrame(fileId, pids[i]);
+    readCache[frame].loading = false;
+    if (reqs[j].result < 0) {
+      dropFrame(frame);
+      rc = RC_FILE_READ_FAILED;
+      continue;
+    }
+
+    // a page that has not reached the disk yet reads as zeros
+    char* page = readCache[frame].buffer;
+    if (reqs[j].result < pageSize) {
+      memset(page + reqs[j].result, 0, pageSize - reqs[j].result);
+    }
+    endChange(frame);
+    if (buffers != NULL) {
+      memcpy(buffers[i], page, pageSize);
+      count(&IoStats::bytesCopied, pageSize);
+    }
+    count(&IoStats::pageReads, 1);
+    count(&IoStats::bytesRead, reqs[j].result);
+  }
+  pthread_cond_broadcast(&cacheCond);
+  pthread_mutex_unlock(&cacheLock);
+
+  // read() traces these pages itself
+  for (unsigned j = 0; rc == 0 && j < later.size(); j++) {
+    rc = read(pids[later[j]], buffers[later[j]]);
+  }
+  return rc;
+}
+
+void PageFile::loadHotSet()
+{
+  HotHeader header;
+  vector<PageId> saved;
+
+  int hf = ::open((name + ".hot").c_str(), O_RDONLY);
+  if (hf < 0) return;
+  if (::read(hf, &header, sizeof(header)) == sizeof(header) && header.magic == HOT_MAGIC &&
+      header.count > 0 && header.count <= HOT_PAGES) {
+    saved.resize(header.count);
+    ssize_t length = header.count * sizeof(PageId);
+    if (::read(hf, &saved[0], length) != length) saved.clear();
+  }
+  ::close(hf);
+
+  //
+  // the file may have shrunk since the hot set was saved. the hottest
+  // pages are taken, up to half of the pool so that the rest of it is
+  // not pushed out, and read in file order.
+  //
+  hotSet.clear();
+  for (int i = (int) saved.size() - 1; i >= 0 && (int) hotSet.size() < cacheCount / 2; i--) {
+    if (saved[i] >= 0 && saved[i] < epid) hotSet.push_back(saved[i]);
+  }
+  std::sort(hotSet.begin(), hotSet.end());
+  hotSet.erase(std::unique(hotSet.begin(), hotSet.end()), hotSet.end());
+  if (hotSet.empty()) return;
+
+  prefetching = (pthread_create(&prefetcher, NULL, prefetchMain, this) == 0);
+}
+
+void PageFile::saveHotSet() const
+{
+  vector<PageId> pids;
+
+  // the replacement policy orders the frames from the coldest to the hottest
+  pthread_mutex_lock(&cacheLock);
+  for (int f = (readCache != NULL) ? policy->first() : -1; f >= 0; f = policy->next(f)) {
+    if (readCache[f].valid && !readCache[f].loading && readCache[f].fileId == fileId) {
+      pids.push_back(readCache[f].pid);
+    }
+  }
+  pthread_mutex_unlock(&cacheLock);
+
+  if (pids.empty()) return;
+  if (pids.size() > (size_t) HOT_PAGES) pids.erase(pids.begin(), pids.end() - HOT_PAGES);
+
+  // if the hot set cannot be saved, the next open only starts out cold
+  HotHeader header;
+  header.magic = HOT_MAGIC;
+  header.count = pids.size();
+  int hf = ::open((name + ".hot").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (hf < 0) return;
+  if (::write(hf, &header, sizeof(header)) == sizeof(header)) {
+    ssize_t length = pids.size() * sizeof(PageId);
+    if (::write(hf, &pids[0], length) != length) ::ftruncate(hf, 0);
+  }
+  ::close(hf);
+}
+
+void* PageFile::prefetchMain(void* arg)
+{
+  const PageFile* file = (const PageFile*) arg;
+  file->readMany(&file->hotSet[0], file->hotSet.size(), NULL);
+  return NULL;
+}
+
+int PageFile::countPins(int& lowest)
+{
+  int pins = 0;
 
+  lowest = 0;
+  pthread_mutex_lock(&cacheLock);
+  for (int i = 0; readCache != NULL && i < cacheCount; i++) {
+    int n = __atomic_load_n(&readCache[i].pins, __ATOMIC_SEQ_CST);
+    if (n < lowest) lowest = n;
+    pins += n;
+  }
+  pthread_mutex_unlock(&cacheLock);
+  return pins;
+}
+
+RC PageFile::setCacheSize(int count)
+{
+  RC rc;
+
+  if (count <= 0) return RC_INVALID_ATTRIBUTE;
+
+  pthread_mutex_lock(&cacheLock);
+
+  // release the current pool, and allocate one of the new size. the
+  // pool of the old size is allocated again if there is no room for it.
+  int old = cacheCount;
+  if ((rc = freeCache()) == 0) {
+    cacheCount = count;
+    if ((rc = initCache()) < 0) {
+      cacheCount = old;
+      initCache();
+    }
+  }
+
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
+
+RC PageFile::setReplacePolicy(const string& name)
+{
+  RC rc;
+
+  if (!ReplacePolicy::isValid(name)) return RC_INVALID_ATTRIBUTE;
+
+  pthread_mutex_lock(&cacheLock);
+
+  // the new policy starts out with an empty pool
+  if ((rc = freeCache()) == 0) policyName = name;
+
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
+
+RC PageFile::setHugePages(bool on)
+{
+  RC rc;
+
+  pthread_mutex_lock(&cacheLock);
+
+  // the pool is allocated from the new kind of memory on its next use
+  if ((rc = freeCache()) == 0) hugePages = on;
+
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
+
+RC PageFile::freeCache()
+{
+  if (readCache == NULL) return 0;
+
+  // the frames cannot move while a page is loading or pinned.
+  // readers without the lock cannot pin a page once the pool is odd.
+  __atomic_add_fetch(&poolVersion, 1, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < cacheCount; i++) {
+    if (readCache[i].loading || __atomic_load_n(&readCache[i].pins, __ATOMIC_SEQ_CST) > 0) {
+      __atomic_add_fetch(&poolVersion, 1, __ATOMIC_RELEASE);
+      return RC_INVALID_ATTRIBUTE;
+    }
+  }
+
+  // write back the dirty pages of every file before dropping them
+  if (flushFile(-1) < 0) {
+    __atomic_add_fetch(&poolVersion, 1, __ATOMIC_RELEASE);
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  if (__atomic_load_n(&optimisticUsed, __ATOMIC_SEQ_CST)) {
+    retiredPools.push_back(readCache);
+    retiredPools.push_back(hashTable);
+    retiredPools.push_back(cacheData);
+  } else {
+    free(readCache);
+    free(hashTable);
+    if (poolMapped > 0) ::munmap(cacheData, poolMapped);
+    else free(cacheData);
+  }
+  poolMapped = 0;
+  delete policy;
+  readCache = NULL;
+  hashTable = NULL;
+  cacheData = NULL;
+  policy = NULL;
+  __atomic_add_fetch(&poolVersion, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+RC PageFile::growFrames(int size)
+{
+  RC rc = 0;
+
+  pthread_mutex_lock(&cacheLock);
+
+  // if the frames are too small, drop the pool. its next allocation
+  // uses frames of the new size.
+  if (size > frameSize) {
+    if ((rc = freeCache()) == RC_INVALID_ATTRIBUTE) rc = RC_FILE_OPEN_FAILED;
+    if (rc == 0) frameSize = size;
+  }
+  if (rc == 0) rc = initCache();
+
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
+
+RC PageFile::initCache()
+{
+  if (readCache != NULL) return 0;
+
+  // use about twice as many hash buckets as frames to keep chains short
+  hashCount = 2 * cacheCount + 1;
+
+  // the frames are large enough for the pages of every open file
+  if (frameSize < defaultPageSize) frameSize = defaultPageSize;
+
+  readCache = (cacheStruct*) malloc(cacheCount * sizeof(cacheStruct));
+  hashTable = (int*) malloc(hashCount * sizeof(int));
+  // aligned for direct I/O. frames are powers of two, so each of them
+  // is aligned to POOL_ALIGN or its own size
+  size_t bytes = (size_t) cacheCount * frameSize;
+  cacheData = hugePages ? mapHugePages(bytes) : NULL;
+  if (cacheData == NULL) {
+    poolMemory = "normal pages";
+    if (posix_memalign((void**) &cacheData, POOL_ALIGN, bytes) != 0) cacheData = NULL;
+  }
+
+  // a pool too large for the memory is not allocated at all
+  if (readCache == NULL || hashTable == NULL || cacheData == NULL) {
+    free(readCache);
+    free(hashTable);
+    if (poolMapped > 0) ::munmap(cacheData, poolMapped);
+    else free(cacheData);
+    poolMapped = 0;
+    readCache = NULL;
+    hashTable = NULL;
+    cacheData = NULL;
+    return RC_OUT_OF_MEMORY;
+  }
+
+  __atomic_add_fetch(&poolVersion, 1, __ATOMIC_SEQ_CST);
+  policy = ReplacePolicy::create(policyName, cacheCount);
+
+  for (int i = 0; i < hashCount; i++) hashTable[i] = -1;
+
+  // all frames start out empty
+  for (int i = 0; i < cacheCount; i++) {
+    readCache[i].fileId = -1;
+    readCache[i].pid = -1;
+    readCache[i].file = NULL;
+    readCache[i].valid = false;
+    readCache[i].dirty = false;
+    readCache[i].loading = false;
+    readCache[i].referenced = false;
+    readCache[i].pins = 0;
+    readCache[i].hashNext = -1;
+    readCache[i].version = 1;
+    readCache[i].buffer = cacheData + (size_t) i * frameSize;
+  }
+  __atomic_add_fetch(&poolVersion, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+char* PageFile::mapHugePages(size_t size)
+{
+  size_t rounded = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+  // the huge pages reserved by the system, if there are enough left
+  void* addr = ::mmap(NULL, rounded, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  if (addr != MAP_FAILED) {
+    poolMemory = "huge pages";
+    poolMapped = rounded;
+    return (char*) addr;
+  }
+
+  //
+  // otherwise transparent huge pages. they can only back whole 2MB
+  // blocks of the address space, so map one more huge page than needed
+  // and trim the mapping down to an aligned block.
+  //
+  addr = ::mmap(NULL, rounded + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) return NULL;
+  char* base = (char*) addr;
+  char* aligned = (char*) (((size_t) base + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+  if (aligned > base) ::munmap(base, aligned - base);
+  if (base + HUGE_PAGE_SIZE > aligned) {
+    ::munmap(aligned + rounded, base + HUGE_PAGE_SIZE - aligned);
+  }
+  if (::madvise(aligned, rounded, MADV_HUGEPAGE) < 0) {
+    ::munmap(aligned, rounded);
+    return NULL;
+  }
+  poolMemory = "transparent huge pages";
+  poolMapped = rounded;
+  return aligned;
+}
+
+int PageFile::hashPage(int fileId, PageId pid, int buckets)
+{
+  unsigned h = (unsigned) fileId * 2654435761u ^ (unsigned) (pid ^ (pid >> 32)) * 40503u;
+  return h % buckets;
+}
+
+int PageFile::findFrame(int fileId, PageId pid)
+{
+  if (initCache() < 0) return -1;
+
+  for (int i = hashTable[hashPage(fileId, pid)]; i >= 0; i = readCache[i].hashNext) {
+    if (readCache[i].fileId == fileId && readCache[i].pid == pid) return i;
+  }
+  return -1;
+}
+
+void PageFile::mapFrame(int frame, const PageFile* file, PageId pid, bool prefetch)
+{
+  int h = hashPage(file->fileId, pid);
+
+  // the frame stays odd until the page is complete in it
+  beginChange(frame);
+  __atomic_store_n(&readCache[frame].fileId, file->fileId, __ATOMIC_RELAXED);
+  __atomic_store_n(&readCache[frame].pid, pid, __ATOMIC_RELAXED);
+  readCache[frame].file = file;
+  readCache[frame].valid = true;
+  readCache[frame].referenced = false;
+  __atomic_store_n(&readCache[frame].hashNext, hashTable[h], __ATOMIC_RELAXED);
+  __atomic_store_n(&hashTable[h], frame, __ATOMIC_RELEASE);
+
+  policy->load(frame, file->fileId, pid, prefetch);
+}
+
+int PageFile::allocFrame(const PageFile* file)
+{
+  // without a pool, there is no frame to take
+  if (readCache == NULL) return -1;
+
+  // the unpin() that makes a frame evictable signals the threads that
+  // wait for one. it must know of them before they look at the pins.
+  __atomic_store_n(&unpinWanted, true, __ATOMIC_SEQ_CST);
+
+  //
+  // take the first frame in the order of the replacement policy that is
+  // neither loading nor pinned. a page hit without the lock gets the
+  // second chance the policy would have given it, and is only evicted
+  // in a second pass if there is no other frame.
+  //
+  int frame = -1;
+  for (int pass = 0; frame < 0 && pass < 2; pass++) {
+    int next;
+    for (frame = policy->first(); frame >= 0; frame = next) {
+      next = policy->next(frame);
+      if (readCache[frame].loading ||
+          __atomic_load_n(&readCache[frame].pins, __ATOMIC_SEQ_CST) > 0) continue;
+      if (__atomic_load_n(&readCache[frame].referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&readCache[frame].referenced, false, __ATOMIC_RELAXED);
+        touchFrame(frame);
+        continue;
+      }
+
+      // once the frame is odd, readers without the lock cannot pin
+      // it anymore. one may have done so just before.
+      beginChange(frame);
+      if (__atomic_load_n(&readCache[frame].pins, __ATOMIC_SEQ_CST) == 0) break;
+      endChange(frame);
+    }
+  }
+  if (frame < 0) return -2;
+
+  if (readCache[frame].valid) {
+    // a dirty page of a logged file only needs to be in the log file,
+    // where it is read from until the next checkpoint
+    if (readCache[frame].dirty) {
+      off_t at = findLogged(readCache[frame].fileId, readCache[frame].pid);
+      if (at >= 0 ? log->writeOut(at + readCache[frame].file->pageSize) < 0
+                  : flushRun(frame) < 0) {
+        endChange(frame);
+        return -1;
+      }
+    }
+    dropFrame(frame, true);
+    file->count(&IoStats::evictions, 1);
+  }
+  return frame;
+}
+
+RC PageFile::flushRun(int frame)
+{
+  int    id = readCache[frame].fileId;
+  const PageFile* file = readCache[frame].file;
+  PageId first = readCache[frame].pid;
+  PageId last = first;
+  int    f;
+
+  // extend the run over the adjacent dirty pages in both directions
+  while (last - first + 1 < IOV_MAX &&
+         (f = findFrame(id, first - 1)) >= 0 && readCache[f].dirty) first--;
+  while (last - first + 1 < IOV_MAX &&
+         (f = findFrame(id, last + 1)) >= 0 && readCache[f].dirty) last++;
+
+  // write the whole run with one system call
+  int count = last - first + 1;
+  struct iovec iov[IOV_MAX];
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = readCache[findFrame(id, first + i)].buffer;
+    iov[i].iov_len = file->pageSize;
+  }
+  file->count(&IoStats::syscalls, 1);
+  if (::pwritev(file->fd, iov, count, file->pageOffset(first)) < 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
+
+  for (PageId pid = first; pid <= last; pid++) {
+    readCache[findFrame(id, pid)].dirty = false;
+  }
+
+  // increase page write count
+  file->count(&IoStats::pageWrites, count);
+  file->count(&IoStats::bytesWritten, (long long) count * file->pageSize);
+
+  return 0;
+}
+
+RC PageFile::flushFile(int fileId)
+{
+  RC rc;
+
+  // the pages of logged files are written by a checkpoint
+  for (int id = 0; log != NULL && id < (int) fileTable.size(); id++) {
+    if ((fileId < 0 || id == fileId) && fileTable[id].writer != NULL &&
+        (rc = fileTable[id].writer->checkpoint()) < 0) return rc;
+  }
+
+  for (int i = 0; i < cacheCount; i++) {
+    if (readCache[i].valid && readCache[i].dirty &&
+        (fileId < 0 || readCache[i].fileId == fileId)) {
+      if ((rc = flushRun(i)) < 0) return rc;
+    }
+  }
+  return 0;
+}
+
+off_t PageFile::findLogged(int fileId, PageId pid)
+{
+  if (loggedPages.empty()) return -1;
+
+  map<PageKey, off_t>::const_iterator it = loggedPages.find(PageKey(fileId, pid));
+  return (it == loggedPages.end()) ? -1 : it->second;
+}
+
+RC PageFile::readLogged(int frame, off_t at) const
+{
+  // the log is read with the cache lock held, as it also
+  // serves the pages that are still in its buffer
+  count(&IoStats::syscalls, 1);
+  if (log->read(at, readCache[frame].buffer, pageSize) < 0) {
+    dropFrame(frame);
+    return RC_FILE_READ_FAILED;
+  }
+
+  count(&IoStats::pageReads, 1);
+  count(&IoStats::bytesRead, pageSize);
+  return 0;
+}
+
+RC PageFile::checkpoint()
+{
+  RC rc;
+
+  map<PageKey, off_t>::iterator begin = loggedPages.lower_bound(PageKey(fileId, 0));
+  map<PageKey, off_t>::iterator end = loggedPages.lower_bound(PageKey(fileId + 1, 0));
+  if (begin == end) return 0;
+
+  // the pages must be committed and durable in the log
+  // before they overwrite their old versions in the file
+  if ((rc = log->commit()) < 0 || (rc = log->sync()) < 0) return rc;
+
+  //
+  // write the pages in the order of their place in the file, each run of
+  // adjacent pages with one system call. a cached page is written from
+  // its frame, and the others are read back from the log first, all
+  // pages of a run in one batch. the sync put all of them in the log file.
+  //
+  char* spare;
+  if (posix_memalign((void**) &spare, POOL_ALIGN, (size_t) IOV_MAX * pageSize) != 0) {
+    return RC_FILE_WRITE_FAILED;
+  }
+  map<PageKey, off_t>::iterator it = begin;
+  while (it != end) {
+    struct iovec iov[IOV_MAX];
+    vector<IoQueue::Request> reqs;
+    PageId first = it->first.second;
+    int pages = 0;
+    while (it != end && pages < IOV_MAX && it->first.second == first + pages) {
+      int frame = findFrame(fileId, it->first.second);
+      if (frame >= 0 && !readCache[frame].loading) {
+        iov[pages].iov_base = readCache[frame].buffer;
+      } else {
+        IoQueue::Request req;
+        req.fd = log->getFd();
+        req.buffer = spare + (size_t) pages * pageSize;
+        req.length = pageSize;
+        req.offset = it->second;
+        req.result = -1;
+        reqs.push_back(req);
+        iov[pages].iov_base = req.buffer;
+      }
+      iov[pages].iov_len = pageSize;
+      pages++;
+      it++;
+    }
+
+    if (!reqs.empty()) {
+      int calls = 0;
+      rc = IoQueue::readBatch(&reqs[0], reqs.size(), &calls);
+      count(&IoStats::syscalls, calls);
+      if (rc < 0) {
+        free(spare);
+        return rc;
+      }
+    }
+
+    count(&IoStats::syscalls, 1);
+    if (::pwritev(fd, iov, pages, pageOffset(first)) < 0) {
+      free(spare);
+      return RC_FILE_WRITE_FAILED;
+    }
+    count(&IoStats::pageWrites, pages);
+    count(&IoStats::bytesWritten, (long long) pages * pageSize);
+  }
+  free(spare);
+
+  count(&IoStats::syscalls, 1);
+  if (::fdatasync(fd) < 0) return RC_FILE_WRITE_FAILED;
+
+  // the cached pages are now the same as in the file
+  for (it = begin; it != end; it++) {
+    int frame = findFrame(fileId, it->first.second);
+    if (frame >= 0) readCache[frame].dirty = false;
+  }
+  loggedPages.erase(begin, end);
+
+  // once no file needs the log, it starts over
+  if (loggedPages.empty()) return log->reset();
+  return 0;
+}
+
+RC PageFile::setLog(const string& filename)
+{
+  RC rc;
+
+  if (log != NULL) return RC_FILE_OPEN_FAILED;
+
+  WriteAheadLog* wal = new WriteAheadLog();
+  if ((rc = wal->open(filename)) < 0) {
+    delete wal;
+    return rc;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+  log = wal;
+  pthread_mutex_unlock(&cacheLock);
   return 0;
 }
+
+RC PageFile::setTrace(const string& filename)
+{
+  RC rc = 0;
+
+  pthread_mutex_lock(&traceLock);
+
+  // end the trace being written
+  if (traceFd >= 0) {
+    __atomic_store_n(&tracing, false, __ATOMIC_RELAXED);
+    if (writeTrace() < 0 || ::close(traceFd) < 0) traceFailed = true;
+    traceFd = -1;
+  }
+  if (traceFailed) rc = RC_FILE_WRITE_FAILED;
+  traceFailed = false;
+  traceBuffer.clear();
+
+  // and start the new one
+  if (rc == 0 && !filename.empty()) {
+    traceFd = ::open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (traceFd < 0) {
+      traceFd = -1;
+      rc = RC_FILE_OPEN_FAILED;
+    } else {
+      TraceHeader header;
+      memset(&header, 0, sizeof(header));
+      header.magic = TRACE_MAGIC;
+      header.version = TRACE_VERSION;
+      header.start = traceLast = traceTime();
+      traceNamed.clear();
+      appendTrace(&header, sizeof(header));
+      __atomic_store_n(&tracing, true, __ATOMIC_RELAXED);
+    }
+  }
+
+  pthread_mutex_unlock(&traceLock);
+  return rc;
+}
+
+void PageFile::trace(PageId pid, int op) const
+{
+  TraceRecord rec;
+
+  if (!__atomic_load_n(&tracing, __ATOMIC_RELAXED)) return;
+
+  pthread_mutex_lock(&traceLock);
+
+  // the records only have room for 2^16 file ids
+  if (traceFd >= 0 && fileId <= USHRT_MAX) {
+    memset(&rec, 0, sizeof(rec));
+    rec.file = fileId;
+
+    // name the file before its first access
+    if (fileId >= (int) traceNamed.size()) traceNamed.resize(fileId + 1, false);
+    if (!traceNamed[fileId]) {
+      char zeros[sizeof(rec)];
+      memset(zeros, 0, sizeof(zeros));
+      rec.pid = name.size();
+      rec.op = TRACE_FILE;
+      appendTrace(&rec, sizeof(rec));
+      appendTrace(name.data(), name.size());
+      appendTrace(zeros, (sizeof(rec) - name.size() % sizeof(rec)) % sizeof(rec));
+      traceNamed[fileId] = true;
+    }
+
+    long long now = traceTime();
+    long long delta = now - traceLast;
+    rec.pid = pid;
+    rec.op = op;
+    rec.delta = (delta < 0) ? 0 : (delta > UINT_MAX) ? UINT_MAX : (unsigned) delta;
+    traceLast = now;
+    appendTrace(&rec, sizeof(rec));
+  }
+
+  pthread_mutex_unlock(&traceLock);
+}
+
+static long long traceTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+static void appendTrace(const void* data, size_t length)
+{
+  if (traceFd < 0) return;
+
+  if (traceBuffer.size() + length > TRACE_BUFFER_SIZE && writeTrace() < 0) {
+    // give up on the trace. setTrace() reports it.
+    __atomic_store_n(&tracing, false, __ATOMIC_RELAXED);
+    ::close(traceFd);
+    traceFd = -1;
+    traceFailed = true;
+    return;
+  }
+  traceBuffer.insert(traceBuffer.end(), (const char*) data, (const char*) data + length);
+}
+
+static RC writeTrace()
+{
+  size_t done = 0;
+  while (done < traceBuffer.size()) {
+    ssize_t n = ::write(traceFd, &traceBuffer[done], traceBuffer.size() - done);
+    if (n <= 0) return RC_FILE_WRITE_FAILED;
+    done += n;
+  }
+  traceBuffer.clear();
+  return 0;
+}
+
+RC PageFile::commit()
+{
+  RC rc;
+
+  if (log == NULL) return 0;
+
+  pthread_mutex_lock(&cacheLock);
+
+  // checkpoint every file once the log grows too large,
+  // so that it does not take long to recover from it
+  rc = log->commit();
+  if (rc == 0 && log->size() > WriteAheadLog::CHECKPOINT_SIZE && readCache != NULL) {
+    rc = flushFile(-1);
+  }
+
+  pthread_mutex_unlock(&cacheLock);
+  return rc;
+}
+
+void PageFile::dropFrame(int frame, bool evicted)
+{
+  // an empty frame stays odd
+  beginChange(frame);
+  policy->remove(frame, readCache[frame].fileId, readCache[frame].pid, evicted);
+
+  // unlink the frame from its hash chain. the frame keeps its link, so
+  // that a reader following the chain without the lock is not cut off.
+  int* link = &hashTable[hashPage(readCache[frame].fileId, readCache[frame].pid)];
+  while (*link != frame) link = &readCache[*link].hashNext;
+  __atomic_store_n(link, readCache[frame].hashNext, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&readCache[frame].fileId, -1, __ATOMIC_RELAXED);
+  __atomic_store_n(&readCache[frame].pid, -1, __ATOMIC_RELAXED);
+  readCache[frame].file = NULL;
+  readCache[frame].valid = false;
+  readCache[frame].dirty = false;
+  readCache[frame].referenced = false;
+
+  // a reader that pinned the frame without the lock just before it
+  // turned odd sees the change and releases its pin again, so the
+  // count is left alone
+  assert(__atomic_load_n(&readCache[frame].pins, __ATOMIC_SEQ_CST) >= 0);
+}
+
+void PageFile::beginChange(int frame)
+{
+  unsigned version = readCache[frame].version;
+  if ((version & 1) == 0) {
+    // the frame must be seen odd before any of the changes that follow
+    __atomic_store_n(&readCache[frame].version, version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+}
+
+void PageFile::endChange(int frame)
+{
+  unsigned version = readCache[frame].version;
+  if (version & 1) __atomic_store_n(&readCache[frame].version, version + 1, __ATOMIC_RELEASE);
+}
+
+void PageFile::releasePin(cacheStruct& frame)
+{
+  // a thread that found every frame pinned is waiting for this
+  if (__atomic_sub_fetch(&frame.pins, 1, __ATOMIC_SEQ_CST) == 0 &&
+      __atomic_load_n(&unpinWanted, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&cacheLock);
+    unpinWanted = false;
+    pthread_cond_broadcast(&cacheCond);
+    pthread_mutex_unlock(&cacheLock);
+  }
+}
+
+void PageFile::touchFrame(int frame)
+{
+  policy->access(frame);
+}
+
+void PageFile::count(long long IoStats::* counter, long long n) const
+{
+  __sync_fetch_and_add(&(stats.*counter), n);
+  __sync_fetch_and_add(&(totals.*counter), n);
+}
+
+void PageFile::countLatency(const struct timespec& begin) const
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long long usec = (end.tv_sec - begin.tv_sec) * 1000000LL +
+                   (end.tv_nsec - begin.tv_nsec) / 1000;
+
+  // the bucket of the smallest power of two above the latency
+  int i = 0;
+  while (i < IoStats::LATENCY_BUCKETS - 1 && (1LL << i) <= usec) i++;
+  __sync_fetch_and_add(&stats.latency[i], 1);
+  __sync_fetch_and_add(&totals.latency[i], 1);
+}
+
+void IoStats::clear()
+{
+  hits = misses = evictions = 0;
+  pageReads = pageWrites = 0;
+  bytesRead = bytesWritten = bytesCopied = 0;
+  syscalls = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) latency[i] = 0;
+}
+
+IoStats IoStats::operator-(const IoStats& other) const
+{
+  IoStats d;
+  d.hits = hits - other.hits;
+  d.misses = misses - other.misses;
+  d.evictions = evictions - other.evictions;
+  d.pageReads = pageReads - other.pageReads;
+  d.pageWrites = pageWrites - other.pageWrites;
+  d.bytesRead = bytesRead - other.bytesRead;
+  d.bytesWritten = bytesWritten - other.bytesWritten;
+  d.bytesCopied = bytesCopied - other.bytesCopied;
+  d.syscalls = syscalls - other.syscalls;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) d.latency[i] = latency[i] - other.latency[i];
+  return d;
+}
+
+long long IoStats::latencyBound(double fraction) const
+{
+  long long total = 0, sum = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) total += latency[i];
+  if (total == 0) return 0;
+
+  // the first bucket by which the fraction of the reads has completed
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    sum += latency[i];
+    if (sum >= fraction * total) return 1LL << i;
+  }
+  return 1LL << (LATENCY_BUCKETS - 1);
+}
@@ -10,33 +10,101 @@
 #ifndef PAGEFILE_H
 #define PAGEFILE_H
 
+#include <pthread.h>
 #include <string>
+#include <sys/types.h>
+#include <vector>
 #include "Bruinbase.h"
 
-typedef int PageId;
+// page ids are 64-bit, so that a file may have more than 2^31 pages
+typedef long long PageId;
+
+class ReplacePolicy;
+class WriteAheadLog;
+
+/**
+ * I/O statistics of a PageFile, or of all PageFiles together.
+ * the counters are updated atomically, so they may be read while
+ * other threads are doing I/O.
+ */
+struct IoStats {
+  static const int LATENCY_BUCKETS = 24;
+
+  long long hits;          // # of page reads served from the buffer pool
+  long long misses;        // # of page reads that missed the buffer pool
+  long long evictions;     // # of pages evicted to make room for the file's pages
+  long long pageReads;     // # of pages read from the disk, or first read from a mapping
+  long long pageWrites;    // # of pages written to the disk
+  long long bytesRead;     // # of bytes read from the disk
+  long long bytesWritten;  // # of bytes written to the disk
+  long long bytesCopied;   // # of bytes copied out of the pool or the mapping
+  long long syscalls;      // # of system calls issued to read or write the file
+  long long latency[LATENCY_BUCKETS];  // # of disk reads by latency. latency[i]
+                                       // counts reads of less than 2^i microseconds
+
+  IoStats() { clear(); }
+
+  /**
+   * set every counter to zero.
+   */
+  void clear();
+
+  /**
+   * @return the counters minus the counters of other
+   */
+  IoStats operator-(const IoStats& other) const;
+
+  /**
+   * @param fraction[IN] a fraction of the disk reads, such as 0.99
+   * @return the latency in microseconds that the fraction of the disk
+   *         reads stayed below. 0 if there were no disk reads
+   */
+  long long latencyBound(double fraction) const;
+};
 
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * pages are read and written with positional I/O through a buffer pool
+ * that is shared by all PageFiles, so several threads may read from the
+ * same open PageFile at the same time. a read or pin of a cached page
+ * takes no lock, so that such threads do not wait on each other.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  static const int PAGE_SIZE = 1024;      // the default size of a page is 1KB
+  static const int MAX_PAGE_SIZE = 65536; // the largest page size is 64KB
+  static const int DEFAULT_CACHE_COUNT = 1024; // default # of cached pages
+  static const int POOL_ALIGN = 4096;     // the alignment of the buffer pool memory
+  static const int HOT_PAGES = 256;       // max # of pages in the hot set of a file
+  static const off_t GROW_MIN = 1 << 20;  // a growing file reserves at least 1MB more
+  static const off_t GROW_MAX = 128 << 20; // and at most 128MB more at a time
+  static const size_t HUGE_PAGE_SIZE = 2 << 20; // the size of a huge page
 
   PageFile();
   PageFile(const std::string& filename, char mode);
 
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * with the default page size, which is recorded in a header at the
+   * beginning of the file. a file without such a header is a legacy
+   * file with PAGE_SIZE pages.
+   * when opened in 'm' mode, the file is read-only and memory-mapped as
+   * a whole. pages are then read from the mapping, bypassing the cache.
+   * otherwise, if none of the pages of the file are cached and its hot
+   * set was saved when it was last closed, the pages of the hot set are
+   * read into the buffer pool in the background.
    * @param filename[IN] the name of the file to open
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for mapped read
    * @return error code. 0 if no error
    */
   RC open(const std::string& filename, char mode);
 
   /**
-   * close the file.
+   * close the file. when the last PageFile of the unix file closes it,
+   * the ids of its hottest cached pages, up to HOT_PAGES of them, are
+   * saved as its hot set in a file named after it with ".hot" appended.
    * @return error code. 0 if no error
    */
   RC close();
@@ -44,20 +112,65 @@ class PageFile {
   /**
    * read a disk page into memory buffer.
    * @param pid[IN] the page to read
-   * @param buffer[OUT] pointer to memory buffer
+   * @param buffer[OUT] pointer to memory buffer of getPageSize() bytes
    * @return error code. 0 if no error
    */
   RC read(PageId pid, void *buffer) const;
+
+  /**
+   * read several disk pages into memory buffers at once.
+   * the pages that are not cached are read from the disk together,
+   * so that they are all in flight at the same time.
+   * @param pids[IN] the pages to read
+   * @param n[IN] # of pages to read
+   * @param buffers[OUT] buffers[i] receives the page pids[i]. if NULL,
+   *                    the pages are only read into the buffer pool,
+   *                    skipping those that are cached or being loaded
+   * @return error code. 0 if no error
+   */
+  RC readMany(const PageId* pids, int n, void** buffers) const;
+
+  /**
+   * pin a disk page in memory and return a pointer to it, so that the
+   * page can be read in place without copying it.
+   * the page stays in the buffer pool until it is unpinned, and every
+   * pin() must be matched by an unpin(). a pinned page must not be
+   * written, and the file must not be closed while pages are pinned.
+   * @param pid[IN] the page to pin
+   * @param page[OUT] the content of the page, getPageSize() bytes
+   * @return error code. 0 if no error
+   */
+  RC pin(PageId pid, const char*& page) const;
+
+  /**
+   * release a page pinned by pin(). the pointer to the page
+   * must not be used afterwards.
+   * @param pid[IN] the pinned page
+   */
+  void unpin(PageId pid) const;
   
   /**
    * write the memory buffer to the disk page.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
+   * in write-back mode the page is only stored in the cache and marked
+   * dirty. it reaches the disk when it is evicted or the file is flushed.
+   * if the file is logged, the page is also appended to the log, and
+   * reaches its place in the file at the next checkpoint.
    * @param pid[IN] page to write to
-   * @param buffer[IN] the content to write
+   * @param buffer[IN] the content to write, getPageSize() bytes
    * @return error code. 0 if no error
    */
   RC write(PageId pid, const void *buffer);
+
+  /**
+   * write all dirty cached pages of the file to the disk.
+   * runs of adjacent dirty pages are written with a single system call.
+   * if the file is logged, the log is committed and synced first, and
+   * the pages logged for the file are checkpointed.
+   * @return error code. 0 if no error
+   */
+  RC flush();
     
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
@@ -67,46 +180,492 @@ class PageFile {
   PageId endPid() const;
 
   /**
-   * @return the total # of disk reads
+   * @return true if the file was opened in 'r' or 'm' mode
    */
-  static int getPageReadCount()  { return readCount; }
-  
+  bool isReadOnly() const { return readOnly; }
+
+  /**
+   * @return true if the file bypasses the kernel page cache
+   */
+  bool isDirect() const { return direct; }
+
+  /**
+   * @return the size of the pages of the file
+   */
+  int getPageSize() const { return pageSize; }
+
+  /**
+   * set the page size of the files created from now on.
+   * @param size[IN] a power of two from PAGE_SIZE to MAX_PAGE_SIZE
+   * @return error code. 0 if no error
+   */
+  static RC setDefaultPageSize(int size);
+
+  /**
+   * @return the page size of the files created from now on
+   */
+  static int getDefaultPageSize() { return defaultPageSize; }
+
+  /**
+   * @return the I/O statistics of the file since it was opened
+   */
+  IoStats getStats() const { return stats; }
+
+  /**
+   * @return the I/O statistics of all files since the program started
+   */
+  static IoStats getTotalStats() { return totals; }
+
   /**
-   * @return the total # of disk writes
+   * set the # of pages in the buffer pool shared by all PageFiles.
+   * the pool is allocated again, so every page that is currently cached
+   * is dropped. if the new pool cannot be allocated, the size is kept.
+   * @param count[IN] the # of pages to cache. must be positive
+   * @return error code. RC_OUT_OF_MEMORY if the pool cannot be allocated
    */
-  static int getPageWriteCount() { return writeCount; }
+  static RC setCacheSize(int count);
 
- protected:
   /**
-   * move the file cursor to the beginning of a page.
-   * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
+   * @return the # of pages in the buffer pool
+   */
+  static int getCacheSize() { return cacheCount; }
+
+  /**
+   * count the pins held on the pages of the buffer pool, for testing.
+   * @param lowest[OUT] the fewest pins held on a page, which is never negative
+   * @return the # of pins held
+   */
+  static int countPins(int& lowest);
+
+  /**
+   * turn write-back caching on or off for all PageFiles.
+   * when it is off, every write() goes to the disk immediately. it is
+   * off by default. when it is on, a page written reaches the disk once
+   * it is evicted or its file is closed, and may be lost in a crash
+   * unless the writes are logged.
+   * @param on[IN] true for write-back, false for write-through
+   */
+  static void setWriteBack(bool on) { writeBack = on; }
+
+  /**
+   * turn direct I/O (O_DIRECT) on or off for the files opened from now
+   * on, so that their pages are cached only in the buffer pool and not
+   * also in the kernel page cache. all I/O of a direct file goes through
+   * the frames of the pool, which are aligned. a file falls back to the
+   * page cache if its file system does not support direct I/O, or needs
+   * a larger alignment than the page size of the file. files opened in
+   * 'm' mode are always mapped.
+   * @param on[IN] true for direct I/O
+   */
+  static void setDirectIo(bool on) { directIo = on; }
+
+  /**
+   * choose the replacement policy of the buffer pool, which decides the
+   * page to evict when the pool is full. "lru" evicts the least recently
+   * used page. "2q" and "lru2" keep pages read only once, such as the
+   * pages of a full scan, from pushing out the pages that are read again
+   * and again. every page that is currently cached is dropped.
+   * @param name[IN] "lru", "2q" or "lru2"
+   * @return error code. 0 if no error
+   */
+  static RC setReplacePolicy(const std::string& name);
+
+  /**
+   * @return the name of the replacement policy of the buffer pool
+   */
+  static const std::string& getReplacePolicy() { return policyName; }
+
+  /**
+   * back the buffer pool with 2MB huge pages, so that a large pool takes
+   * up fewer TLB entries. the pool takes huge pages reserved by the
+   * system (MAP_HUGETLB) if there are enough of them, and otherwise asks
+   * for transparent huge pages. if neither is available, it falls back
+   * to normal pages. every page that is currently cached is dropped.
+   * @param on[IN] true for huge pages, false for normal pages
+   * @return error code. 0 if no error
+   */
+  static RC setHugePages(bool on);
+
+  /**
+   * turn preallocation on or off for the files opened from now on.
+   * when it is on, a file that grows reserves its disk space in chunks
+   * as large as the space reserved so far, from GROW_MIN to GROW_MAX,
+   * so that a large load writes into a few contiguous extents rather
+   * than extending the file a page at a time. the size of the file only
+   * covers the pages written, and the space reserved past them is given
+   * back when the file is closed. it is off by default.
+   * @param on[IN] true to preallocate
+   */
+  static void setPreallocate(bool on) { preallocate = on; }
+
+  /**
+   * serve reads and pins of cached pages without taking the cache lock,
+   * or always take it. this is on by default, and only turned off to
+   * compare the two.
+   * @param on[IN] true for lock-free hits
+   */
+  static void setOptimisticReads(bool on) { optimistic = on; }
+
+  /**
+   * @return the kind of memory the buffer pool was last allocated from:
+   *         "huge pages", "transparent huge pages" or "normal pages"
+   */
+  static const char* getPoolMemory() { return poolMemory; }
+
+  /**
+   * log the writes to every file opened in 'w' mode from now on.
+   * the pages written are appended to the log instead of being written
+   * in place, and an update becomes durable, as a whole, once commit()
+   * has been called and the log is synced. a dirty page that is evicted
+   * is read back from the log. the logged pages are written to their
+   * files at checkpoints: when a file is flushed or closed, and when the
+   * log grows beyond WriteAheadLog::CHECKPOINT_SIZE. a logged file is
+   * always written back, even when write-back caching is off.
+   * if the log holds updates committed before a crash, they are applied
+   * to their files first.
+   * @param filename[IN] the name of the log file
+   * @return error code. 0 if no error
+   */
+  static RC setLog(const std::string& filename);
+
+  /**
+   * @return the log. NULL if writes are not logged
+   */
+  static const WriteAheadLog* getLog() { return log; }
+
+  /**
+   * end an update of the logged files. the pages written since the last
+   * commit survive a crash together, or not at all. the commit itself
+   * is durable once the log is synced, which happens every so many
+   * commits, and when a logged file is flushed or closed.
    * @return error code. 0 if no error
    */
-  RC seek(PageId pid) const;
+  static RC commit();
+
+  /**
+   * record every page read and written through a PageFile from now on,
+   * with the file, the page, and the time of the access, in a trace
+   * file of the format of PageTrace.h. tracesim replays the trace
+   * against buffer pools of other sizes and replacement policies.
+   * the pages the pool reads ahead or prefetches on its own are not
+   * recorded, as they are not accesses. a trace that is already being
+   * written is ended first.
+   * @param filename[IN] the name of the trace file. "" to end the trace
+   * @return error code. 0 if no error
+   */
+  static RC setTrace(const std::string& filename);
 
  private:
-  int     fd;     // file descriptor of the associated unix file
-  PageId  epid;   // (last page id + 1) of the file
+  int     fd;       // file descriptor of the associated unix file
+  int     fileId;   // the id of the unix file in the buffer pool
+  PageId  epid;     // (last page id + 1) of the file
+  bool    readOnly; // true if the file was opened in 'r' or 'm' mode
+  bool    direct;   // true if the file is read and written with O_DIRECT
+  int     pageSize; // the size of the pages of the file
+  off_t   dataOffset; // the file offset of page 0, after the header
+  char*   mapAddr;  // the mapping of the file in 'm' mode (NULL otherwise)
+  int     logFile;  // the number of the file in the log. -1 if not logged
+  unsigned char* touched; // bitmap of the pages read from the mapping
+  off_t   allocEnd; // the physical end of the file: the end of the space
+                    // reserved for it, at or past the logical end,
+                    // pageOffset(epid). -1 if nothing is preallocated
+  std::string name; // the name of the unix file
+
+  //
+  // the hot set of the file, saved when it is closed and read into the
+  // buffer pool by a background thread when it is opened again.
+  // it is saved in the file named after the file with ".hot" appended.
+  //
+  std::vector<PageId> hotSet;  // the pages the background thread reads
+  pthread_t prefetcher;        // the background thread
+  bool      prefetching;       // true if the thread has to be joined
 
   //
-  // the following set of members implement LRU caching 
+  // sequential read-ahead. a read of the page right after the one read
+  // last also reads the following pages, raWindow of them in total.
   //
-  static const int CACHE_COUNT = 10;
+  static const int READ_AHEAD_MIN = 4;   // the first read-ahead window
+  static const int READ_AHEAD_MAX = 64;  // the largest read-ahead window
+  mutable PageId raLast;    // the page read last
+  mutable PageId raNext;    // the first page past the window read ahead
+  mutable int    raWindow;  // # of pages to read with the next read-ahead
 
-  static int cacheClock; // clock tick counter for LRU policy
+  mutable IoStats stats;    // the I/O statistics of the file
+  static IoStats  totals;   // the I/O statistics of all files
+
+  /**
+   * add n to a counter of the file and to the same counter of the totals.
+   * @param counter[IN] the counter, such as &IoStats::hits
+   * @param n[IN] the amount to add
+   */
+  void count(long long IoStats::* counter, long long n) const;
+
+  /**
+   * record the latency of a disk read in the histograms of the file
+   * and of the totals.
+   * @param begin[IN] the time the read started
+   */
+  void countLatency(const struct timespec& begin) const;
+
+  static int defaultPageSize;  // the page size of newly created files
+
+  /**
+   * @return true if the size can be used as a page size
+   */
+  static bool validPageSize(int size);
+
+  /**
+   * turn on O_DIRECT for the open file if its pages allow it.
+   * @return true if the file now bypasses the kernel page cache
+   */
+  bool enableDirect();
+
+  /**
+   * @return the file offset of the page
+   */
+  off_t pageOffset(PageId pid) const { return dataOffset + (off_t) pid * pageSize; }
+
+  /**
+   * reserve disk space up to the end of the page, if it is past the
+   * physical end of the file. the size of the file stays the same.
+   * if the file system cannot preallocate, the file grows as it is written.
+   * must be called without the cache lock.
+   */
+  void reserve(PageId pid);
+
+  /**
+   * give back the space reserved past the logical end of the file.
+   * the caller holds growLock.
+   */
+  void trim();
+
+  /**
+   * count the page of the mapping as read if it is touched for the first time.
+   */
+  void touchMapped(PageId pid) const;
+
+  /**
+   * in a sequential scan of the mapping, have the kernel read ahead
+   * the pages that follow the page.
+   */
+  void readAheadMapped(PageId pid) const;
+
+  /**
+   * serve a hit without taking the cache lock. the frame of the page is
+   * read optimistically, and the read only counts if the version of the
+   * frame and of the pool are the same before and after.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] receives a copy of the page. if NULL, the page
+   *                    is pinned instead
+   * @param page[OUT] the pinned page, if buffer is NULL
+   * @return true if the page was served. false if it has to be looked
+   *         up with the lock held
+   */
+  bool readOptimistic(PageId pid, void* buffer, const char*& page) const;
+
+  /**
+   * read the saved hot set of the file, and start reading its pages
+   * into the buffer pool in the background.
+   */
+  void loadHotSet();
+
+  /**
+   * save the hottest cached pages of the file as its hot set.
+   */
+  void saveHotSet() const;
+
+  /**
+   * the body of the background thread reading the hot set.
+   * @param arg[IN] the PageFile
+   */
+  static void* prefetchMain(void* arg);
+
+  /**
+   * find the frame caching the page, reading the page into a new frame
+   * if it is not cached. during a sequential scan the pages that follow
+   * are read along with it. the cache lock must be held, and it is
+   * released while the page is read from the disk.
+   * @return the frame. an error code (< 0) if there is an error
+   */
+  int fetchFrame(PageId pid) const;
+
+  /**
+   * read the page logged at the given log offset into the frame.
+   * the cache lock must be held.
+   * @return error code. 0 if no error
+   */
+  RC readLogged(int frame, off_t at) const;
+
+  /**
+   * write the pages logged for the file to their places in the file and
+   * sync it, so that the log no longer needs them. the log is committed
+   * and synced first. the cache lock must be held.
+   * @return error code. 0 if no error
+   */
+  RC checkpoint();
+
+  /**
+   * add an access to a page of the file to the trace, if there is one.
+   * @param op[IN] TRACE_READ or TRACE_WRITE
+   */
+  void trace(PageId pid, int op) const;
+
+  //
+  // the following set of members implement the buffer pool.
+  // cached pages are found through a hash table on (file id, pid), and
+  // the replacement policy decides which frame to evict next.
+  // all of them, and the page counters, are protected by one mutex
+  // that is released while a missing page is read from the disk.
+  // frames that are loading or pinned are never evicted.
+  // hits are served without the mutex, by readOptimistic(). every frame
+  // has a version that is odd while the frame changes or is empty, like
+  // a seqlock, and so has the pool as a whole. pins are taken and
+  // released with atomic operations.
+  //
+  static int cacheCount; // # of frames in the buffer pool
+  static int frameSize;  // the size of each frame, the largest page size in use
+  static int hashCount;  // # of buckets in the hash table
 
   // the actual cache data structure
   static struct cacheStruct {
-    int    fd;              // file id of the cached page
+    int    fileId;          // file id of the cached page
     PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+    const PageFile* file;   // an open PageFile of the page. set while dirty
+    bool   valid;           // false if the frame is empty
+    bool   dirty;           // true if the page is newer than the disk copy
+    bool   loading;         // true while the page is being read from the disk
+    bool   referenced;      // true if the page was hit without the lock since
+                            // the replacement policy last heard of it
+    int    pins;            // # of pin() calls not matched by unpin() yet
+    int    hashNext;        // next frame in the same hash bucket (-1: none)
+    unsigned version;       // odd while the frame is empty or changing
+    char*  buffer;          // the buffer used for caching
+  } *readCache;
 
-  static int readCount;  // total # of page reads 
-  static int writeCount; // total # of page writes 
+  static int*  hashTable;   // first frame of each hash bucket (-1: none)
+  static char* cacheData;   // the memory backing all frame buffers
+  static ReplacePolicy* policy;      // orders the frames for eviction
+  static std::string policyName;     // the name of the policy
+  static bool  writeBack;   // true if writes are deferred until eviction
+  static bool  directIo;    // true if files are opened with O_DIRECT
+  static bool  preallocate; // true if growing files reserve space in chunks
+  static bool  hugePages;   // true if the pool is to be backed by huge pages
+  static bool  optimistic;  // true if hits may be served without the lock
+  static const char* poolMemory; // the kind of memory backing the pool
+  static size_t poolMapped; // # of bytes mapped for the pool. 0 if it was allocated
+  static WriteAheadLog* log; // the log of the writes. NULL if not logging
+
+  /**
+   * allocate the buffer pool if it has not been allocated yet.
+   * @return error code. RC_OUT_OF_MEMORY if the pool cannot be allocated
+   */
+  static RC initCache();
+
+  /**
+   * map memory for the buffer pool from huge pages, setting poolMemory
+   * and poolMapped.
+   * @param size[IN] # of bytes needed
+   * @return the memory, aligned to HUGE_PAGE_SIZE. NULL if neither
+   *         reserved nor transparent huge pages are available
+   */
+  static char* mapHugePages(size_t size);
+
+  /**
+   * write back the dirty pages and release the buffer pool.
+   * it is allocated again on its next use.
+   * @return error code. RC_INVALID_ATTRIBUTE if a page is loading or pinned
+   */
+  static RC freeCache();
+
+  /**
+   * make the frames of the buffer pool at least size bytes large, and
+   * allocate the pool if it is not allocated.
+   * if they are smaller, every cached page is written back and dropped.
+   * @param size[IN] the page size the frames must hold
+   * @return error code. 0 if no error
+   */
+  static RC growFrames(int size);
+
+  /**
+   * @return the hash bucket of the page (fileId, pid)
+   */
+  static int hashPage(int fileId, PageId pid, int buckets = hashCount);
+
+  /**
+   * @return the frame caching the page (fileId, pid). -1 if it is not cached
+   */
+  static int findFrame(int fileId, PageId pid);
+
+  /**
+   * @return the log offset of the page (fileId, pid) if it was logged
+   *         since the last checkpoint. -1 otherwise
+   */
+  static off_t findLogged(int fileId, PageId pid);
+
+  /**
+   * register the frame as the cache of the page (file, pid).
+   * @param frame[IN] an empty frame
+   * @param file[IN] the file of the page
+   * @param pid[IN] the page id of the page
+   * @param prefetch[IN] true if the page is read ahead of its use
+   */
+  static void mapFrame(int frame, const PageFile* file, PageId pid, bool prefetch = false);
+
+  /**
+   * empty the frame the replacement policy picks, writing it back first
+   * if dirty. a dirty page of a logged file is only written to the log.
+   * @param file[IN] the file that needs the frame, charged with the eviction
+   * @return the empty frame. -1 if the dirty page could not be written,
+   *         -2 if every frame is busy loading a page or pinned
+   */
+  static int allocFrame(const PageFile* file);
+
+  /**
+   * write the dirty page in the frame to the disk together with
+   * the dirty pages of the same file that are adjacent to it.
+   * @param frame[IN] a frame holding a dirty page
+   * @return error code. 0 if no error
+   */
+  static RC flushRun(int frame);
+
+  /**
+   * write all dirty cached pages of a file to the disk, checkpointing
+   * the file if it is logged.
+   * @param fileId[IN] the file whose pages to write. -1 for all files
+   * @return error code. 0 if no error
+   */
+  static RC flushFile(int fileId);
+
+  /**
+   * remove the page cached in the frame from the pool.
+   * @param frame[IN] the frame to empty
+   * @param evicted[IN] true if the page makes room for another page
+   */
+  static void dropFrame(int frame, bool evicted = false);
+
+  /**
+   * make the frame odd, so that readers without the lock stay away
+   * while it changes. the cache lock must be held.
+   */
+  static void beginChange(int frame);
+
+  /**
+   * make the frame even again, once it holds a complete page.
+   * the cache lock must be held.
+   */
+  static void endChange(int frame);
+
+  /**
+   * release a pin of the frame, waking up the threads waiting for a
+   * frame to evict if it was the last one. the cache lock is not needed.
+   */
+  static void releasePin(cacheStruct& frame);
+
+  /**
+   * tell the replacement policy that the page in the frame was used.
+   * @param frame[IN] the frame that was just accessed
+   */
+  static void touchFrame(int frame);
 };
   
 #endif // PAGEFILE_H
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef PAGETRACE_H
+#define PAGETRACE_H
+
+#include "PageFile.h"
+
+//
+// the format of the page access traces written by PageFile::setTrace()
+// and replayed by tracesim. a trace is a TraceHeader followed by
+// TraceRecords. a TRACE_FILE record comes before the first access to a
+// file. it holds the length of the file name in pid, and is followed by
+// the name, padded with zeros to a multiple of sizeof(TraceRecord).
+//
+static const int TRACE_MAGIC   = 0x52544242;  // "BBTR"
+static const int TRACE_VERSION = 1;
+
+enum { TRACE_READ = 1, TRACE_WRITE = 2, TRACE_FILE = 3 };
+
+struct TraceHeader {
+  int       magic;    // TRACE_MAGIC
+  int       version;  // TRACE_VERSION
+  long long start;    // the time the trace started, in microseconds since the epoch
+};
+
+struct TraceRecord {
+  PageId         pid;    // the page accessed
+  unsigned       delta;  // microseconds since the record before
+  unsigned short file;   // the id of the file in the buffer pool
+  unsigned char  op;     // TRACE_READ, TRACE_WRITE or TRACE_FILE
+  unsigned char  pad;    // 0
+};
+
+#endif // PAGETRACE_H
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// measure the throughput of point lookups in a B+tree index that is
+// cached in the buffer pool, from 1 thread up to a given # of threads,
+// with the cache lock taken on every hit and with lock-free hits.
+//
+// usage: poolbench [max_threads] [keys] [seconds]
+//
+
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "PageFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using std::vector;
+
+static const char* INDEX_FILE = "poolbench.idx";
+
+static BTreeIndex tree;    // the index all threads look up keys in
+static int  keyCount;      // the keys in the index are 0 .. keyCount - 1
+static bool stopped;       // set to end a measurement
+static bool failed;        // set if a lookup did not find its key
+
+struct Worker {
+  pthread_t thread;
+  unsigned  seed;     // for rand_r()
+  long long lookups;  // # of lookups done
+};
+
+// look up random keys until stopped
+static void* lookupMain(void* arg)
+{
+  Worker* w = (Worker*) arg;
+  IndexCursor cursor;
+  RecordId rid;
+  int key;
+
+  while (!__atomic_load_n(&stopped, __ATOMIC_RELAXED)) {
+    int searchKey = rand_r(&w->seed) % keyCount;
+    if (tree.locate(searchKey, cursor) < 0 ||
+        tree.readForward(cursor, key, rid) < 0 || key != searchKey || rid.pid != searchKey) {
+      __atomic_store_n(&failed, true, __ATOMIC_RELAXED);
+      break;
+    }
+    w->lookups++;
+  }
+  return NULL;
+}
+
+// @return the # of lookups per second that the threads do together
+static double measure(int threads, double seconds)
+{
+  vector<Worker> workers(threads);
+  struct timespec begin, end;
+
+  stopped = false;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int i = 0; i < threads; i++) {
+    workers[i].seed = i + 1;
+    workers[i].lookups = 0;
+    pthread_create(&workers[i].thread, NULL, lookupMain, &workers[i]);
+  }
+  usleep((useconds_t) (seconds * 1000000));
+  __atomic_store_n(&stopped, true, __ATOMIC_RELAXED);
+
+  long long total = 0;
+  for (int i = 0; i < threads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    total += workers[i].lookups;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return total / ((end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = (argc > 1) ? atoi(argv[1]) : 8;
+  keyCount = (argc > 2) ? atoi(argv[2]) : 100000;
+  double seconds = (argc > 3) ? atof(argv[3]) : 1.0;
+  if (maxThreads <= 0 || keyCount <= 0 || seconds <= 0) {
+    fprintf(stderr, "usage: %s [max_threads] [keys] [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  // build the index with the keys in random order
+  unlink(INDEX_FILE);
+  if (tree.open(INDEX_FILE, 'w') < 0) {
+    fprintf(stderr, "cannot create %s\n", INDEX_FILE);
+    return 1;
+  }
+  vector<int> keys(keyCount);
+  for (int i = 0; i < keyCount; i++) keys[i] = i;
+  unsigned seed = 1;
+  for (int i = keyCount - 1; i > 0; i--) std::swap(keys[i], keys[rand_r(&seed) % (i + 1)]);
+  for (int i = 0; i < keyCount; i++) {
+    RecordId rid;
+    rid.pid = keys[i];
+    rid.sid = 0;
+    if (tree.insert(keys[i], rid) < 0) {
+      fprintf(stderr, "cannot insert key %d\n", keys[i]);
+      return 1;
+    }
+  }
+  tree.close();
+
+  // the whole index fits in the pool, so every lookup only hits
+  PageFile probe;
+  probe.open(INDEX_FILE, 'r');
+  int pages = (int) probe.endPid();
+  probe.close();
+  if (PageFile::getCacheSize() < 2 * pages) PageFile::setCacheSize(2 * pages);
+  tree.open(INDEX_FILE, 'r');
+  PageFile::setOptimisticReads(true);
+  measure(1, seconds / 4);
+
+  printf("%d keys, %d index pages, %ld cpus\n", keyCount, pages, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("threads  locked lookups/s  lock-free lookups/s  speedup\n");
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    PageFile::setOptimisticReads(false);
+    double locked = measure(threads, seconds);
+    PageFile::setOptimisticReads(true);
+    double optimistic = measure(threads, seconds);
+    printf("%7d  %17.0f  %19.0f  %6.2fx\n", threads, locked, optimistic, optimistic / locked);
+  }
+
+  tree.close();
+  unlink(INDEX_FILE);
+  if (failed) {
+    fprintf(stderr, "a lookup returned a wrong entry\n");
+    return 1;
+  }
+  return 0;
+}
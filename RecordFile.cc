@@ -9,29 +9,146 @@
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include <climits>
 #include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
+using std::map;
 using std::string;
+using std::vector;
+
+//
+// a page holds its records in one of four formats, told apart by the
+// first four bytes of the page.
+// a legacy page starts with its # of records, which is never negative,
+// followed by as many fixed slots as fit in the page, each a key and a
+// zero-terminated value of up to MAX_VALUE_LENGTH bytes.
+// a slotted page starts with a PageHeader. the records are packed at
+// the end of the page, the last one first, and a directory of their
+// offsets and lengths grows from the header towards them. a record is
+// its key followed by its value, without a terminating zero.
+// a PAX page is laid out like a slotted page, except that the keys are
+// not in the records. they form an array of their own right after the
+// header, and the directory follows the array. the directory is moved
+// along as the array grows, so a page is only added to in memory.
+// a dictionary page is a PAX page that keeps every distinct value of
+// the page once. its DictHeader is followed by the key array, an array
+// of the 16-bit codes of the values of the records, and the directory
+// of the distinct values, which the codes index.
+// new pages are slotted, PAX or dictionary pages, as set by
+// setLayout(). a legacy page that is not full yet is appended to in its
+// own format, so files written before stay as they are.
+//
+static const int SLOTTED_PAGE = -1;
+static const int PAX_PAGE = -2;
+static const int DICT_PAGE = -3;
+
+struct PageHeader {
+  int format;     // SLOTTED_PAGE, PAX_PAGE or DICT_PAGE
+  int count;      // # records in the page
+  int dataStart;  // the offset of the first byte of record data
+};
+
+struct DictHeader {
+  PageHeader page;  // with the format DICT_PAGE
+  int values;       // # distinct values in the page
+};
+
+struct SlotEntry {
+  unsigned short offset;  // the offset of the record in the page
+  unsigned short length;  // # bytes of the record. the key is included
+                          // in a slotted page only
+};
+
+//
+// the zone map of a file is saved in a file of its own when the file is
+// closed: this header, followed by the PageZones of the pages from
+// first on. a zone whose minKey is larger than its maxKey is not known.
+// the header names the file the zones are of by its inode, size and
+// modification time after it was closed, so that the zone map of a file
+// that was replaced or written to behind our back is not used.
+//
+static const int ZONE_MAGIC = 0x325a4242;  // "BBZ2"
+
+struct ZoneHeader {
+  int    magic;   // ZONE_MAGIC
+  int    endSid;  // the end record id of the file when the zone map was saved
+  PageId endPid;
+  PageId first;   // the page of the first zone
+  PageId count;   // # of zones that follow
+  dev_t  dev;     // the device of the file
+  ino_t  ino;     // the inode of the file
+  off_t  size;    // the size of the file when the zone map was saved
+  struct timespec mtime;  // and its modification time
+};
+
+// @return true if the header names the file as it is now
+static bool sameFile(const ZoneHeader& header, const struct stat& statbuf);
+
+int RecordFile::layout = SLOTTED_PAGE;
 
 //
 // helper functions for page manipultation
 //
 
-// compute the pointer to the n'th slot in a page
+// @return true if the page is a legacy page
+static bool isLegacy(const char* page);
+
+// @return the format of a page that is not a legacy page
+static int getFormat(const char* page);
+
+// @return the offset of the key array of a PAX or dictionary page. -1 for other pages
+static int keyArray(const char* page);
+
+// @return the code of the value of the n'th record in a dictionary page
+static int getCode(const char* page, int n);
+
+// @return # of fixed slots in a legacy page of the given size
+static int legacySlots(int pageSize);
+
+// compute the pointer to the n'th slot in a legacy page
 static char* slotPtr(char* page, int n);
 
 // read the record in the n'th slot in the page
 static void readSlot(const char* page, int n, int& key, std::string& value);
 
-// write the record to the n'th slot in the page
+// locate the record in the n'th slot in the page, without copying its value
+static void viewSlot(const char* page, int n, int& key, const char*& value, int& length);
+
+// write the record to the n'th slot in a legacy page
 static void writeSlot(char* page, int n, int key, const std::string& value);
 
 // get # records stored in the page
 static int getRecordCount(const char* page);
 
-// update # records stored in the page
+// update # records stored in a legacy page
 static void setRecordCount(char* page, int count);
 
+// make the page an empty page of the given format
+static void initPage(char* page, int pageSize, int format);
+
+// make the zone one that no record is in
+static void clearZone(PageZone& zone);
+
+// widen the zone to take in the record
+static void widen(PageZone& zone, int key, const char* value, int length);
+
+// @return the page the cursor is about to move to. -1 if it is in the middle of a page
+static PageId zonePid(const RecordCursor& cursor);
+
+// add the record to a slotted or PAX page. false if there is no room for it
+static bool addRecord(char* page, int key, const std::string& value);
+
+// add the record to a dictionary page. false if there is no room for it
+static bool addCoded(char* page, int key, const char* value, int length);
+
+// @return the code of the value in a dictionary page. -1 if it is not there
+static int findCode(const char* page, const char* value, int length);
+
 
 //
 // helper functions for RecordId manipulation
@@ -107,20 +224,38 @@ RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  recordsPerPage = RECORDS_PER_PAGE;
+  countPid = -1;
+  countValue = 0;
+  zoneBase = 0;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  erid.pid = 0;
+  erid.sid = 0;
+  recordsPerPage = RECORDS_PER_PAGE;
+  countPid = -1;
+  countValue = 0;
+  zoneBase = 0;
   open(filename, mode);
 }
 
 RC RecordFile::open(const string& filename, char mode)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  char page[PageFile::MAX_PAGE_SIZE];
 
   // open the page file
   if ((rc = pf.open(filename, mode)) < 0) return rc;
+
+  // a dictionary page holds the most records when their values are the same
+  recordsPerPage = (pf.getPageSize() - sizeof(DictHeader)) / (sizeof(unsigned short) + sizeof(int));
+  countPid = -1;
+  name = filename;
+  zoneName = filename + ".zone";
+  zones.clear();
+  zoneBase = 0;
   
   //
   // in the rest of this function, we set the end record id
@@ -130,7 +265,8 @@ RC RecordFile::open(const string& filename, char mode)
   erid.pid = pf.endPid();
 
   // if the end pid is zero, the file is empty.
-  // set the end record id to (0, 0).
+  // set the end record id to (0, 0). the zone map of a file that was
+  // there before is removed on close.
   if (erid.pid == 0) {
     erid.sid = 0;
     return 0;
@@ -146,75 +282,370 @@ RC RecordFile::open(const string& filename, char mode)
     return rc;
   }
 
-  // get # records in the last page
+  // get # records in the last page. whether a slotted page has room
+  // for another record depends on the record, and is left to append().
   erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  if (isLegacy(page) && erid.sid >= legacySlots(pf.getPageSize())) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
   }
-  
+
+  loadZoneMap();
   return 0;
 }
 
 RC RecordFile::close()
 {
+  RC rc;
+  bool writable = !pf.isReadOnly();
+
+  // the zone map is saved once the pages are written, so that it names
+  // the file as it is left
+  if ((rc = pf.close()) == 0 && writable) saveZoneMap();
+  zones.clear();
   erid.pid = 0;
   erid.sid = 0;
+  countPid = -1;
 
-  return pf.close();
+  return rc;
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  const char* page;
   
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // pin the page containing the record instead of copying it
+  if ((rc = pf.pin(rid.pid, page)) < 0) return rc;
+
+  // the page may hold fewer records than it could
+  countPid = rid.pid;
+  countValue = getRecordCount(page);
+  if (rid.sid >= countValue) {
+    pf.unpin(rid.pid);
+    return RC_INVALID_RID;
+  }
 
   // read the record from the slot in the page
   readSlot(page, rid.sid, key, value);
 
+  pf.unpin(rid.pid);
+  return 0;
+}
+
+RC RecordFile::readMany(const RecordId* rids, int n, int* keys, string* values) const
+{
+  RC rc;
+  map<PageId, int> slot;   // the buffer slot of every distinct page
+  vector<PageId>   pids;   // the distinct pages to read
+
+  // check the rids and collect the distinct pages holding them
+  for (int i = 0; i < n; i++) {
+    const RecordId& rid = rids[i];
+    if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+    if (rid.sid < 0 || rid.sid >= recordsPerPage) return RC_INVALID_RID;
+    if (rid >= erid) return RC_INVALID_RID;
+
+    if (slot.find(rid.pid) == slot.end()) {
+      slot[rid.pid] = pids.size();
+      pids.push_back(rid.pid);
+    }
+  }
+  if (pids.empty()) return 0;
+
+  // read all the pages at once
+  vector<char>  pages(pids.size() * pf.getPageSize());
+  vector<void*> buffers(pids.size());
+  for (unsigned i = 0; i < pids.size(); i++) {
+    buffers[i] = &pages[i * pf.getPageSize()];
+  }
+  if ((rc = pf.readMany(&pids[0], pids.size(), &buffers[0])) < 0) return rc;
+
+  // read the records from the slots in the pages
+  for (int i = 0; i < n; i++) {
+    const char* page = (const char*) buffers[slot[rids[i].pid]];
+    if (rids[i].sid >= getRecordCount(page)) return RC_INVALID_RID;
+    readSlot(page, rids[i].sid, keys[i], values[i]);
+  }
+
   return 0;
 }
 
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
+{
+  return appendBatch(&key, &value, 1, &rid);
+}
+
+RC RecordFile::appendBatch(const int* keys, const string* values, int n, RecordId* rids)
 {
   RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  char page[PageFile::MAX_PAGE_SIZE];
+  RecordId end = erid;  // the end record id once the page in memory is written
+  bool loaded = false;  // true if the page end.pid is in memory
+
+  // the # of records cached for the pages written is gone
+  if (countPid >= erid.pid) countPid = -1;
+
+  for (int i = 0; i < n; i++) {
+    // unless we are writing to the the first slot of an empty page,
+    // we have to read the page first
+    if (!loaded) {
+      if (end.sid > 0) {
+        if ((rc = pf.read(end.pid, page)) < 0) return rc;
+
+        // the zone of a page written without a zone map is taken from
+        // the records in it
+        PageZone zone;
+        if (!getZone(end.pid, zone)) {
+          int count = getRecordCount(page);
+          for (int j = 0; j < count; j++) {
+            RecordId rid = { end.pid, j };
+            const char* value;
+            int key, length;
+            viewSlot(page, j, key, value, length);
+            widenZone(rid, key, value, length);
+          }
+        }
+      } else {
+        initPage(page, pf.getPageSize(), layout);
+      }
+      loaded = true;
+    }
+
+    if (isLegacy(page)) {
+      // a legacy page is filled in its own format. open() made sure
+      // that it has a free slot.
+      writeSlot(page, end.sid, keys[i], values[i]);
+      setRecordCount(page, end.sid + 1);
+    } else if (!addRecord(page, keys[i], values[i])) {
+      // the record does not fit in the page. write the page out,
+      // and start the next one with the record.
+      if ((rc = pf.write(end.pid, page)) < 0) return rc;
+      erid = end;
+      end.pid++;
+      end.sid = 0;
+      initPage(page, pf.getPageSize(), layout);
+      addRecord(page, keys[i], values[i]);
+    }
+
+    // we need to output the rid of the record slot
+    rids[i] = end;
+    int length = values[i].size();
+    if (length >= MAX_VALUE_LENGTH) length = MAX_VALUE_LENGTH - 1;
+    widenZone(end, keys[i], values[i].data(), length);
+    end.sid++;
+
+    // a full legacy page is written right away, and the next record
+    // goes to the next page
+    if (isLegacy(page) && end.sid >= legacySlots(pf.getPageSize())) {
+      if ((rc = pf.write(end.pid, page)) < 0) return rc;
+      end.pid++;
+      end.sid = 0;
+      erid = end;
+      loaded = false;
+    }
+  }
+
+  // write the last page, which the next append may add to
+  if (loaded && end.sid > 0) {
+    if ((rc = pf.write(end.pid, page)) < 0) return rc;
+  }
+  erid = end;
+
+  return 0;
+}
+
+void RecordFile::startScan(RecordCursor& cursor) const
+{
+  cursor.rid.pid = 0;
+  cursor.rid.sid = 0;
+  cursor.page = NULL;
+  cursor.count = 0;
+  cursor.code = -1;
+}
+
+RC RecordFile::readForward(RecordCursor& cursor, int& key, const char*& value, int& length) const
+{
+  RC rc;
 
-  // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
-  if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
+  if ((rc = fetchPage(cursor)) < 0) return rc;
+
+  viewSlot(cursor.page, cursor.rid.sid, key, value, length);
+  cursor.code = (getFormat(cursor.page) == DICT_PAGE) ? getCode(cursor.page, cursor.rid.sid) : -1;
+  cursor.rid.sid++;
+  return 0;
+}
+
+RC RecordFile::readKeys(RecordCursor& cursor, int* keys, int& count) const
+{
+  RC rc;
+  const char* value;
+  int length;
+
+  if ((rc = fetchPage(cursor)) < 0) return rc;
+
+  // the keys of a PAX or dictionary page are copied at once.
+  // the records of the other pages are visited one by one.
+  count = cursor.count - cursor.rid.sid;
+  int offset = keyArray(cursor.page);
+  if (offset >= 0) {
+    memcpy(keys, cursor.page + offset + cursor.rid.sid * sizeof(int), count * sizeof(int));
   } else {
-    // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+    for (int i = 0; i < count; i++) {
+      viewSlot(cursor.page, cursor.rid.sid + i, keys[i], value, length);
+    }
+  }
+  cursor.rid.sid = cursor.count;
+  return 0;
+}
+
+int RecordFile::codeOf(const RecordCursor& cursor, const char* value) const
+{
+  if (cursor.page == NULL || getFormat(cursor.page) != DICT_PAGE) return NOT_CODED;
+  return ::findCode(cursor.page, value, strlen(value));
+}
+
+void RecordFile::skipPage(RecordCursor& cursor) const
+{
+  if (cursor.page != NULL) cursor.rid.sid = cursor.count;
+}
+
+bool RecordFile::nextZone(const RecordCursor& cursor, PageZone& zone) const
+{
+  PageId pid = zonePid(cursor);
+  return pid >= 0 && getZone(pid, zone);
+}
+
+void RecordFile::skipZone(RecordCursor& cursor) const
+{
+  PageId pid = zonePid(cursor);
+  if (pid < 0) return;
+
+  if (cursor.page != NULL) pf.unpin(cursor.rid.pid);
+  cursor.page = NULL;
+  cursor.rid.pid = pid + 1;
+  cursor.rid.sid = 0;
+  cursor.count = 0;
+}
+
+bool RecordFile::getZone(PageId pid, PageZone& zone) const
+{
+  if (pid < zoneBase || pid - zoneBase >= (PageId) zones.size()) return false;
+  zone = zones[pid - zoneBase];
+  return zone.minKey <= zone.maxKey;
+}
+
+void RecordFile::widenZone(const RecordId& rid, int key, const char* value, int length)
+{
+  if (zones.empty()) zoneBase = rid.pid;
+  if (rid.pid < zoneBase) return;
+
+  // the pages are appended to in order, so the zone map only grows at its end
+  PageId n = rid.pid - zoneBase;
+  if (n >= (PageId) zones.size()) {
+    PageZone unknown;
+    clearZone(unknown);
+    zones.resize(n + 1, unknown);
   }
-    
-  // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  if (rid.sid == 0) clearZone(zones[n]);
+  widen(zones[n], key, value, length);
+}
 
-  // the first four bytes in the page stores # records in the page.
-  // update this number.
-  setRecordCount(page, erid.sid + 1);
+void RecordFile::loadZoneMap()
+{
+  ZoneHeader header;
+  struct stat statbuf;
+
+  if (::stat(name.c_str(), &statbuf) < 0) return;
+  int zf = ::open(zoneName.c_str(), O_RDONLY);
+  if (zf < 0) return;
+  if (::read(zf, &header, sizeof(header)) == sizeof(header) && header.magic == ZONE_MAGIC &&
+      sameFile(header, statbuf) &&
+      header.first >= 0 && header.count > 0 && header.first + header.count <= erid.pid + 1) {
+    zones.resize(header.count);
+    ssize_t length = header.count * sizeof(PageZone);
+    if (::read(zf, &zones[0], length) != length) zones.clear();
+    zoneBase = header.first;
+  }
+  ::close(zf);
 
-  // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
-    
-  // we need to output the rid of the record slot
-  rid = erid;
+  // the file is as it was when the zone map was saved, so it ends
+  // where it did then
+  RecordId end = { header.endPid, header.endSid };
+  if (end != erid) zones.clear();
+}
 
-  // advance the end record id by one to the next empty slot
-  ++erid;
+void RecordFile::saveZoneMap()
+{
+  ZoneHeader header;
+  struct stat statbuf;
 
+  // a file without a zone map has its pages read
+  if (zones.empty() || ::stat(name.c_str(), &statbuf) < 0) {
+    ::unlink(zoneName.c_str());
+    return;
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = ZONE_MAGIC;
+  header.endSid = erid.sid;
+  header.endPid = erid.pid;
+  header.first = zoneBase;
+  header.count = zones.size();
+  header.dev = statbuf.st_dev;
+  header.ino = statbuf.st_ino;
+  header.size = statbuf.st_size;
+  header.mtime = statbuf.st_mtim;
+  int zf = ::open(zoneName.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (zf < 0) return;
+  if (::write(zf, &header, sizeof(header)) == sizeof(header)) {
+    ssize_t length = zones.size() * sizeof(PageZone);
+    if (::write(zf, &zones[0], length) != length) ::ftruncate(zf, 0);
+  }
+  ::close(zf);
+}
+
+RC RecordFile::fetchPage(RecordCursor& cursor) const
+{
+  RC rc;
+
+  // pin the next page once the records of the pinned one are used up
+  while (cursor.page == NULL || cursor.rid.sid >= cursor.count) {
+    if (cursor.page != NULL) {
+      pf.unpin(cursor.rid.pid);
+      cursor.page = NULL;
+      cursor.rid.pid++;
+      cursor.rid.sid = 0;
+    }
+    if (cursor.rid >= erid) return RC_NO_SUCH_RECORD;
+
+    if ((rc = pf.pin(cursor.rid.pid, cursor.page)) < 0) {
+      cursor.page = NULL;
+      return rc;
+    }
+    cursor.count = getRecordCount(cursor.page);
+  }
+  return 0;
+}
+
+void RecordFile::endScan(RecordCursor& cursor) const
+{
+  if (cursor.page != NULL) pf.unpin(cursor.rid.pid);
+  cursor.page = NULL;
+}
+
+RC RecordFile::setLayout(const string& name)
+{
+  if (name == "slotted") layout = SLOTTED_PAGE;
+  else if (name == "pax") layout = PAX_PAGE;
+  else if (name == "dict") layout = DICT_PAGE;
+  else return RC_INVALID_ATTRIBUTE;
   return 0;
 }
 
@@ -223,18 +654,71 @@ const RecordId& RecordFile::endRid() const
   return erid;
 }
 
+void RecordFile::nextRid(RecordId& rid) const
+{
+  // if the end of a page is reached, move to the next page
+  if (++rid.sid >= getSlotCount(rid.pid)) {
+    rid.pid++;
+    rid.sid = 0;
+  }
+}
+
+int RecordFile::getSlotCount(PageId pid) const
+{
+  const char* page;
+
+  // the last page may not have been written yet
+  if (pid == erid.pid) return erid.sid;
+  if (pid > erid.pid) return 0;
+
+  // a scan reads the page right before it asks
+  if (pid != countPid) {
+    // a page that cannot be read is left to read() to report
+    if (pf.pin(pid, page) < 0) return recordsPerPage;
+    countPid = pid;
+    countValue = getRecordCount(page);
+    pf.unpin(pid);
+  }
+  return countValue;
+}
+
+static bool isLegacy(const char* page)
+{
+  return getFormat(page) >= 0;
+}
+
+static int getFormat(const char* page)
+{
+  int format;
+
+  memcpy(&format, page, sizeof(int));
+  return format;
+}
+
+static int legacySlots(int pageSize)
+{
+  // the first four bytes in the page is used to store # records in the page
+  return (pageSize - sizeof(int)) / (sizeof(int) + RecordFile::MAX_VALUE_LENGTH);
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
 
-  // the first four bytes of a page contains # records in the page
+  if (!isLegacy(page)) {
+    PageHeader header;
+    memcpy(&header, page, sizeof(header));
+    return header.count;
+  }
+
+  // the first four bytes of a legacy page contains # records in the page
   memcpy(&count, page, sizeof(int));
   return count;
 }
 
 static void setRecordCount(char* page, int count)
 {
-  // the first four bytes of a page contains # records in the page
+  // the first four bytes of a legacy page contains # records in the page
   memcpy(page, &count, sizeof(int));
 }
 
@@ -249,14 +733,62 @@ static char* slotPtr(char* page, int n)
 
 static void readSlot(const char* page, int n, int& key, std::string& value)
 {
+  const char* ptr;
+  int length;
+
+  viewSlot(page, n, key, ptr, length);
+  value.assign(ptr, length);
+}
+
+static void viewSlot(const char* page, int n, int& key, const char*& value, int& length)
+{
+  if (getFormat(page) == SLOTTED_PAGE) {
+    // find the record through the directory
+    SlotEntry entry;
+    memcpy(&entry, page + sizeof(PageHeader) + n * sizeof(SlotEntry), sizeof(entry));
+    memcpy(&key, page + entry.offset, sizeof(int));
+    value = page + entry.offset + sizeof(int);
+    length = entry.length - sizeof(int);
+    return;
+  }
+
+  if (getFormat(page) == DICT_PAGE) {
+    // the key is in the array, and the code indexes the directory
+    // of the distinct values, after the array of the codes
+    DictHeader header;
+    SlotEntry entry;
+    memcpy(&header, page, sizeof(header));
+    memcpy(&key, page + sizeof(header) + n * sizeof(int), sizeof(int));
+    const char* dir = page + sizeof(header) +
+                      header.page.count * (sizeof(int) + sizeof(unsigned short));
+    memcpy(&entry, dir + getCode(page, n) * sizeof(SlotEntry), sizeof(entry));
+    value = page + entry.offset;
+    length = entry.length;
+    return;
+  }
+
+  if (getFormat(page) == PAX_PAGE) {
+    // the key is in the array, and the directory follows it
+    PageHeader header;
+    SlotEntry entry;
+    memcpy(&header, page, sizeof(header));
+    memcpy(&key, page + sizeof(header) + n * sizeof(int), sizeof(int));
+    memcpy(&entry, page + sizeof(header) + header.count * sizeof(int) + n * sizeof(SlotEntry),
+           sizeof(entry));
+    value = page + entry.offset;
+    length = entry.length;
+    return;
+  }
+
   // compute the location of the record
   char *ptr = slotPtr(const_cast<char*>(page), n);
 
   // read the key 
   memcpy(&key, ptr, sizeof(int));
 
-  // read the value
-  value.assign(ptr + sizeof(int));
+  // the value ends with a zero, at the end of the slot at the latest
+  value = ptr + sizeof(int);
+  length = strnlen(value, RecordFile::MAX_VALUE_LENGTH);
 }
 
 static void writeSlot(char* page, int n, int key, const std::string& value)
@@ -276,3 +808,169 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
     strcpy(ptr + sizeof(int), value.c_str());
   }
 }
+
+static void clearZone(PageZone& zone)
+{
+  zone.minKey = INT_MAX;
+  zone.maxKey = INT_MIN;
+  memset(zone.minValue, 0xff, ZONE_PREFIX);
+  memset(zone.maxValue, 0, ZONE_PREFIX);
+}
+
+static void widen(PageZone& zone, int key, const char* value, int length)
+{
+  char cut[ZONE_PREFIX];
+
+  memset(cut, 0, ZONE_PREFIX);
+  memcpy(cut, value, (length < ZONE_PREFIX) ? length : ZONE_PREFIX);
+  if (key < zone.minKey) zone.minKey = key;
+  if (key > zone.maxKey) zone.maxKey = key;
+  if (memcmp(cut, zone.minValue, ZONE_PREFIX) < 0) memcpy(zone.minValue, cut, ZONE_PREFIX);
+  if (memcmp(cut, zone.maxValue, ZONE_PREFIX) > 0) memcpy(zone.maxValue, cut, ZONE_PREFIX);
+}
+
+static PageId zonePid(const RecordCursor& cursor)
+{
+  if (cursor.page == NULL) return (cursor.rid.sid == 0) ? cursor.rid.pid : -1;
+  return (cursor.rid.sid >= cursor.count) ? cursor.rid.pid + 1 : -1;
+}
+
+static int keyArray(const char* page)
+{
+  if (getFormat(page) == PAX_PAGE) return sizeof(PageHeader);
+  if (getFormat(page) == DICT_PAGE) return sizeof(DictHeader);
+  return -1;
+}
+
+static int getCode(const char* page, int n)
+{
+  PageHeader header;
+  unsigned short code;
+
+  memcpy(&header, page, sizeof(header));
+  memcpy(&code, page + sizeof(DictHeader) + header.count * sizeof(int) +
+         n * sizeof(code), sizeof(code));
+  return code;
+}
+
+static void initPage(char* page, int pageSize, int format)
+{
+  DictHeader header;
+
+  // the header of a page other than a dictionary page is shorter,
+  // and ends before values
+  memset(page, 0, pageSize);
+  header.page.format = format;
+  header.page.count = 0;
+  header.page.dataStart = pageSize;
+  header.values = 0;
+  memcpy(page, &header, (format == DICT_PAGE) ? sizeof(header) : sizeof(header.page));
+}
+
+static bool addRecord(char* page, int key, const std::string& value)
+{
+  PageHeader header;
+  SlotEntry entry;
+
+  memcpy(&header, page, sizeof(header));
+  bool pax = (header.format == PAX_PAGE);
+
+  // a value is cut to as long as a legacy slot would keep it
+  int length = value.size();
+  if (length >= RecordFile::MAX_VALUE_LENGTH) length = RecordFile::MAX_VALUE_LENGTH - 1;
+  if (header.format == DICT_PAGE) return addCoded(page, key, value.data(), length);
+
+  // the record, its directory entry and its key have to fit between
+  // the directory and the records already in the page
+  int dirEnd = sizeof(header) + header.count * (sizeof(SlotEntry) + (pax ? sizeof(int) : 0));
+  if (header.dataStart - dirEnd < (int) (sizeof(SlotEntry) + sizeof(int)) + length) return false;
+
+  if (pax) {
+    // make room for the key at the end of the array
+    char* keyEnd = page + sizeof(header) + header.count * sizeof(int);
+    memmove(keyEnd + sizeof(int), keyEnd, header.count * sizeof(SlotEntry));
+    memcpy(keyEnd, &key, sizeof(int));
+    dirEnd += sizeof(int);
+
+    header.dataStart -= length;
+    memcpy(page + header.dataStart, value.data(), length);
+    entry.length = length;
+  } else {
+    header.dataStart -= sizeof(int) + length;
+    memcpy(page + header.dataStart, &key, sizeof(int));
+    memcpy(page + header.dataStart + sizeof(int), value.data(), length);
+    entry.length = sizeof(int) + length;
+  }
+
+  entry.offset = header.dataStart;
+  memcpy(page + dirEnd, &entry, sizeof(entry));
+  header.count++;
+  memcpy(page, &header, sizeof(header));
+  return true;
+}
+
+static bool addCoded(char* page, int key, const char* value, int length)
+{
+  DictHeader header;
+  SlotEntry entry;
+
+  memcpy(&header, page, sizeof(header));
+  int count = header.page.count;
+
+  // a value already in the page only takes a code. a new one is added
+  // to the directory.
+  int code = findCode(page, value, length);
+  int needed = sizeof(int) + sizeof(unsigned short);
+  if (code < 0) needed += sizeof(SlotEntry) + length;
+  int used = sizeof(header) + count * (sizeof(int) + sizeof(unsigned short)) +
+             header.values * sizeof(SlotEntry);
+  if (header.page.dataStart - used < needed) return false;
+
+  // make room for the key at the end of the key array, and for the code
+  // at the end of the code array
+  char* keyEnd = page + sizeof(header) + count * sizeof(int);
+  memmove(keyEnd + sizeof(int), keyEnd,
+          count * sizeof(unsigned short) + header.values * sizeof(SlotEntry));
+  memcpy(keyEnd, &key, sizeof(int));
+  char* codeEnd = keyEnd + sizeof(int) + count * sizeof(unsigned short);
+  memmove(codeEnd + sizeof(unsigned short), codeEnd, header.values * sizeof(SlotEntry));
+  char* dir = codeEnd + sizeof(unsigned short);
+
+  if (code < 0) {
+    header.page.dataStart -= length;
+    memcpy(page + header.page.dataStart, value, length);
+    entry.offset = header.page.dataStart;
+    entry.length = length;
+    memcpy(dir + header.values * sizeof(SlotEntry), &entry, sizeof(entry));
+    code = header.values++;
+  }
+  unsigned short c = code;
+  memcpy(codeEnd, &c, sizeof(c));
+
+  header.page.count++;
+  memcpy(page, &header, sizeof(header));
+  return true;
+}
+
+static int findCode(const char* page, const char* value, int length)
+{
+  DictHeader header;
+  SlotEntry entry;
+
+  memcpy(&header, page, sizeof(header));
+  const char* dir = page + sizeof(header) +
+                    header.page.count * (sizeof(int) + sizeof(unsigned short));
+  for (int code = 0; code < header.values; code++) {
+    memcpy(&entry, dir + code * sizeof(SlotEntry), sizeof(entry));
+    if (entry.length == length && memcmp(page + entry.offset, value, length) == 0) return code;
+  }
+  return -1;
+}
+
+static bool sameFile(const ZoneHeader& header, const struct stat& statbuf)
+{
+  return header.dev == statbuf.st_dev && header.ino == statbuf.st_ino &&
+         header.size == statbuf.st_size &&
+         header.mtime.tv_sec == statbuf.st_mtim.tv_sec &&
+         header.mtime.tv_nsec == statbuf.st_mtim.tv_nsec;
+}
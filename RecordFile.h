@@ -11,6 +11,7 @@
 #define RECORDFILE_H
 
 #include <string>
+#include <vector>
 #include "PageFile.h"
 
 /**
@@ -26,7 +27,9 @@ typedef struct {
 // helper functions for RecordId
 // 
 
-// RecordId iterators
+// RecordId iterators. they step through the legacy pages of a file with
+// the default PageFile::PAGE_SIZE pages. use RecordFile::nextRid() for
+// other files.
 RecordId& operator++ (RecordId& rid);
 RecordId  operator++ (RecordId& rid, int);
 
@@ -39,7 +42,41 @@ bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
 /**
- * read/write a record to a file
+ * The data structure for scanning a RecordFile page by page.
+ * A RecordCursor keeps the page it is in pinned, and the values read
+ * through it point into that page.
+ */
+typedef struct {
+  RecordId    rid;    // the next record to read
+  const char* page;   // the pinned page rid.pid. NULL if none is pinned
+  int         count;  // # records in the pinned page
+  int         code;   // the code of the value read last in a dictionary page. -1 in other pages
+} RecordCursor;
+
+// # of bytes of a value kept in a PageZone
+static const int ZONE_PREFIX = 12;
+
+/**
+ * The range of the keys and values of the records in a page, kept for
+ * the pages of a RecordFile in its zone map. A value is cut to its first
+ * ZONE_PREFIX bytes, padded with zeros, which keeps the order of values.
+ */
+typedef struct {
+  int  minKey;                 // the smallest key in the page
+  int  maxKey;                 // the largest key in the page
+  char minValue[ZONE_PREFIX];  // the smallest value in the page, cut
+  char maxValue[ZONE_PREFIX];  // the largest value in the page, cut
+} PageZone;
+
+/**
+ * read/write a record to a file.
+ * the records are kept in slotted pages, which hold as many records as
+ * their values leave room for, or in PAX pages, which also keep the keys
+ * of their records together in an array, or in dictionary pages, which
+ * are PAX pages that keep each distinct value once and a code of it for
+ * every record. pages written by older
+ * versions, with RECORDS_PER_PAGE fixed slots per page, are still read
+ * and appended to.
  */
 class RecordFile {
  public:
@@ -47,7 +84,10 @@ class RecordFile {
   // maximum length of the value field
   static const int MAX_VALUE_LENGTH = 100;  
 
-  // number of record slots per page
+  // the code of a value looked up in a page that is not a dictionary page
+  static const int NOT_CODED = -2;
+
+  // number of fixed record slots per legacy page of the default size.
   static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
     // Note that we subtract sizeof(int) from PAGE_SIZE because the first
     // four bytes in the page is used to store # records in the page.
@@ -59,7 +99,7 @@ class RecordFile {
    * open a file in read or write mode.
    * when opened in 'w' mode, if the file does not exist, it is created.
    * @param filename[IN] the name of the file to open
-   * @param mode[IN] 'r' for read, 'w' for write
+   * @param mode[IN] 'r' for read, 'w' for write, 'm' for mapped read
    * @return error code. 0 if no error
    */
   RC open(const std::string& filename, char mode);
@@ -79,6 +119,17 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read several records from the file at once.
+   * the pages holding the records are read from the disk together.
+   * @param rids[IN] the ids of the records to read
+   * @param n[IN] # of records to read
+   * @param keys[OUT] keys[i] receives the key of the record rids[i]
+   * @param values[OUT] values[i] receives the value of the record rids[i]
+   * @return error code. 0 if no error
+   */
+  RC readMany(const RecordId* rids, int n, int* keys, std::string* values) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
@@ -90,15 +141,168 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append several records at the end of the file, in order.
+   * the records are placed in pages in memory, and every page is
+   * written once, when it is full or the batch ends.
+   * if there is an error, the records up to the last page written
+   * have been appended.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values
+   * @param n[IN] # of records to append
+   * @param rids[OUT] rids[i] receives the location of the record keys[i]
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const int* keys, const std::string* values, int n, RecordId* rids);
+
+  /**
+   * set the cursor to the first record of the file.
+   * @param cursor[OUT] the cursor to start a scan with
+   */
+  void startScan(RecordCursor& cursor) const;
+
+  /**
+   * read the record at the cursor, and move the cursor to the next one.
+   * each page is fetched once, and the value is not copied: it points
+   * into the page, is not zero-terminated, and stays valid until the
+   * cursor moves to the next page, which may be on the next call.
+   * @param cursor[IN/OUT] the cursor
+   * @param key[OUT] the record key
+   * @param value[OUT] the first byte of the record value
+   * @param length[OUT] # of bytes in the record value
+   * @return error code. RC_NO_SUCH_RECORD at the end of the file
+   */
+  RC readForward(RecordCursor& cursor, int& key, const char*& value, int& length) const;
+
+  /**
+   * read the keys of the records from the cursor to the end of its page,
+   * and move the cursor to the next page. the keys of a PAX page are
+   * copied from the key array, without looking at the values.
+   * @param cursor[IN/OUT] the cursor
+   * @param keys[OUT] the keys. room for getRecordsPerPage() keys is needed
+   * @param count[OUT] # of keys read
+   * @return error code. RC_NO_SUCH_RECORD at the end of the file
+   */
+  RC readKeys(RecordCursor& cursor, int* keys, int& count) const;
+
+  /**
+   * end a scan, releasing the page the cursor holds.
+   * @param cursor[IN/OUT] the cursor
+   */
+  void endScan(RecordCursor& cursor) const;
+
+  /**
+   * look up a value in the dictionary of the page of the cursor.
+   * two records of a dictionary page have the same value if and only if
+   * they have the same code, which readForward() puts in cursor.code.
+   * @param cursor[IN] the cursor, after a record of the page was read
+   * @param value[IN] the value to look up
+   * @return the code of the value in the page. -1 if no record of the
+   *         page has the value, NOT_CODED if it is not a dictionary page
+   */
+  int codeOf(const RecordCursor& cursor, const char* value) const;
+
+  /**
+   * move the cursor past the records left in its page.
+   * @param cursor[IN/OUT] the cursor
+   */
+  void skipPage(RecordCursor& cursor) const;
+
+  /**
+   * get the zone of the page the cursor is about to move to, so that
+   * the page can be skipped without reading it. the zones of the pages
+   * records are appended to are kept in a file of their own, next to
+   * the record file.
+   * @param cursor[IN] the cursor
+   * @param zone[OUT] the zone of the page
+   * @return true if the cursor is at the end of a page, or has not
+   *         started yet, and the zone of the next page is known
+   */
+  bool nextZone(const RecordCursor& cursor, PageZone& zone) const;
+
+  /**
+   * move the cursor past the page nextZone() gave the zone of.
+   * @param cursor[IN/OUT] the cursor
+   */
+  void skipZone(RecordCursor& cursor) const;
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
+  /**
+   * move the record id to the next record slot in the file.
+   * @param rid[IN/OUT] the record id to advance
+   */
+  void nextRid(RecordId& rid) const;
+
+  /**
+   * @return the most records a page of the file can hold
+   */
+  int getRecordsPerPage() const { return recordsPerPage; }
+
+  /**
+   * @return the I/O statistics of the file since it was opened
+   */
+  IoStats getStats() const { return pf.getStats(); }
+
+  /**
+   * set the layout of the pages that are added to a file from now on.
+   * the pages already in a file keep theirs.
+   * @param name[IN] "slotted" (the default), "pax" or "dict"
+   * @return error code. 0 if no error
+   */
+  static RC setLayout(const std::string& name);
+
  private:
   PageFile pf;     // the PageFile used to store the records
   RecordId erid;   // the last record id of the file + 1
+  int recordsPerPage;  // the most records a page of the file can hold
+  mutable PageId countPid;  // the page whose # of records was looked up last
+  mutable int countValue;   // and its # of records
+  std::string name;            // the name of the file
+  std::string zoneName;        // the file the zone map is saved in
+  std::vector<PageZone> zones; // the zone map, from the page zoneBase on
+  PageId zoneBase;             // the page of zones[0]
+
+  static int layout;  // the format of new pages
+
+  /**
+   * make sure the page of the cursor is pinned and has a record at the
+   * cursor, moving the cursor on to the next page if it has not.
+   * @return error code. RC_NO_SUCH_RECORD at the end of the file
+   */
+  RC fetchPage(RecordCursor& cursor) const;
+
+  /**
+   * @return # of records in the page
+   */
+  int getSlotCount(PageId pid) const;
+
+  /**
+   * @return true if the zone of the page is known
+   */
+  bool getZone(PageId pid, PageZone& zone) const;
+
+  /**
+   * widen the zone of a page to take in a record added to the page.
+   * the zone starts over with the first record of the page.
+   */
+  void widenZone(const RecordId& rid, int key, const char* value, int length);
+
+  /**
+   * read the zone map of the file, if it was saved when the file was
+   * last closed and the file is not changed since.
+   */
+  void loadZoneMap();
+
+  /**
+   * save the zone map of the file after it was closed, naming the file
+   * as it is now.
+   */
+  void saveZoneMap();
 };
 
 #endif // RECORDFILE_H
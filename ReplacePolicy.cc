@@ -0,0 +1,307 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include "ReplacePolicy.h"
+
+using std::list;
+using std::string;
+
+ReplacePolicy* ReplacePolicy::create(const string& name, int count)
+{
+  if (name == "lru") return new LruPolicy(count);
+  if (name == "2q") return new TwoQPolicy(count);
+  if (name == "lru2") return new Lru2Policy(count);
+  return NULL;
+}
+
+bool ReplacePolicy::isValid(const string& name)
+{
+  return name == "lru" || name == "2q" || name == "lru2";
+}
+
+void ReplacePolicy::initList(FrameList& list, int count)
+{
+  list.head = -1;
+  list.tail = -1;
+  list.size = 0;
+
+  if ((int) prevFrame.size() < count) {
+    prevFrame.resize(count, -1);
+    nextFrame.resize(count, -1);
+  }
+}
+
+void ReplacePolicy::pushFront(FrameList& list, int frame)
+{
+  prevFrame[frame] = -1;
+  nextFrame[frame] = list.head;
+  if (list.head >= 0) prevFrame[list.head] = frame;
+  else list.tail = frame;
+  list.head = frame;
+  list.size++;
+}
+
+void ReplacePolicy::pushBack(FrameList& list, int frame)
+{
+  prevFrame[frame] = list.tail;
+  nextFrame[frame] = -1;
+  if (list.tail >= 0) nextFrame[list.tail] = frame;
+  else list.head = frame;
+  list.tail = frame;
+  list.size++;
+}
+
+void ReplacePolicy::unlink(FrameList& list, int frame)
+{
+  if (prevFrame[frame] >= 0) nextFrame[prevFrame[frame]] = nextFrame[frame];
+  else list.head = nextFrame[frame];
+  if (nextFrame[frame] >= 0) prevFrame[nextFrame[frame]] = prevFrame[frame];
+  else list.tail = prevFrame[frame];
+  prevFrame[frame] = -1;
+  nextFrame[frame] = -1;
+  list.size--;
+}
+
+
+LruPolicy::LruPolicy(int count)
+{
+  // all frames start out empty and linked on the list in order
+  initList(lru, count);
+  for (int i = 0; i < count; i++) pushBack(lru, i);
+}
+
+void LruPolicy::load(int frame, int /* fileId */, PageId /* pid */, bool /* prefetch */)
+{
+  access(frame);
+}
+
+void LruPolicy::access(int frame)
+{
+  if (frame == lru.head) return;
+
+  // move the frame in front of the list
+  unlink(lru, frame);
+  pushFront(lru, frame);
+}
+
+void LruPolicy::remove(int frame, int /* fileId */, PageId /* pid */, bool /* evicted */)
+{
+  // an empty frame is the first one to be reused
+  if (frame == lru.tail) return;
+  unlink(lru, frame);
+  pushBack(lru, frame);
+}
+
+
+TwoQPolicy::TwoQPolicy(int count)
+{
+  // the sizes suggested for A1in and A1out in the 2Q paper
+  kin = count / 4;
+  kout = count / 2;
+  if (kin < 1) kin = 1;
+  if (kout < 1) kout = 1;
+
+  for (int i = 0; i < 3; i++) initList(lists[i], count);
+  where.resize(count, FREE);
+  for (int i = 0; i < count; i++) pushBack(lists[FREE], i);
+}
+
+void TwoQPolicy::load(int frame, int fileId, PageId pid, bool /* prefetch */)
+{
+  unlink(lists[(int) where[frame]], frame);
+
+  // a page that was evicted from A1in not long ago is worth keeping.
+  // a page seen for the first time goes through A1in first.
+  std::map<PageKey, list<PageKey>::iterator>::iterator it;
+  it = ghosts.find(PageKey(fileId, pid));
+  if (it != ghosts.end()) {
+    a1out.erase(it->second);
+    ghosts.erase(it);
+    where[frame] = AM;
+  } else {
+    where[frame] = A1IN;
+  }
+  pushFront(lists[(int) where[frame]], frame);
+}
+
+void TwoQPolicy::access(int frame)
+{
+  // a page on A1in stays there. accesses that come soon after the
+  // first one are usually part of the same scan or transaction.
+  if (where[frame] != AM || frame == lists[AM].head) return;
+
+  unlink(lists[AM], frame);
+  pushFront(lists[AM], frame);
+}
+
+void TwoQPolicy::remove(int frame, int fileId, PageId pid, bool evicted)
+{
+  // remember the pages evicted from A1in, forgetting the oldest ones
+  if (evicted && where[frame] == A1IN) {
+    PageKey key(fileId, pid);
+    if (ghosts.find(key) == ghosts.end()) {
+      a1out.push_front(key);
+      ghosts[key] = a1out.begin();
+      if ((int) a1out.size() > kout) {
+        ghosts.erase(a1out.back());
+        a1out.pop_back();
+      }
+    }
+  }
+
+  unlink(lists[(int) where[frame]], frame);
+  where[frame] = FREE;
+  pushBack(lists[FREE], frame);
+}
+
+int TwoQPolicy::nextList(int list) const
+{
+  // the empty frames go first. then A1in is taken from while it is over
+  // its share of the pool, and Am otherwise.
+  bool a1inFirst = lists[A1IN].size > kin;
+  switch (list) {
+  case -1:
+    return FREE;
+  case FREE:
+    return a1inFirst ? A1IN : AM;
+  case A1IN:
+    return a1inFirst ? AM : -1;
+  default:
+    return a1inFirst ? -1 : A1IN;
+  }
+}
+
+int TwoQPolicy::first() const
+{
+  for (int l = nextList(-1); l >= 0; l = nextList(l)) {
+    if (lists[l].tail >= 0) return lists[l].tail;
+  }
+  return -1;
+}
+
+int TwoQPolicy::next(int frame) const
+{
+  if (prevFrame[frame] >= 0) return prevFrame[frame];
+
+  // the oldest frame of the next list that is not empty
+  for (int l = nextList(where[frame]); l >= 0; l = nextList(l)) {
+    if (lists[l].tail >= 0) return lists[l].tail;
+  }
+  return -1;
+}
+
+
+Lru2Policy::Lru2Policy(int count)
+{
+  clock = 0;
+  lastFrame = -1;
+  retain = count;
+
+  hist1.resize(count, -1);
+  hist2.resize(count, -1);
+  unused.resize(count, false);
+  for (int i = 0; i < count; i++) order.insert(rank(i));
+}
+
+Lru2Policy::Order Lru2Policy::rank(int frame) const
+{
+  // empty frames first, then the pages referenced once by their only
+  // reference, then the others by their second most recent reference
+  if (hist1[frame] < 0) return Order(std::make_pair((int) FREE, (long long) frame), frame);
+  if (hist2[frame] < 0) return Order(std::make_pair((int) ONCE, hist1[frame]), frame);
+  return Order(std::make_pair((int) TWICE, hist2[frame]), frame);
+}
+
+void Lru2Policy::reference(int frame)
+{
+  // a reference right after one to the same page is correlated with it
+  if (frame == lastFrame) return;
+
+  hist2[frame] = hist1[frame];
+  hist1[frame] = ++clock;
+  lastFrame = frame;
+}
+
+void Lru2Policy::load(int frame, int fileId, PageId pid, bool prefetch)
+{
+  order.erase(rank(frame));
+
+  // use the last reference of the page from before its eviction, if known
+  hist1[frame] = -1;
+  std::map<PageKey, std::pair<long long, list<PageKey>::iterator> >::iterator it;
+  it = history.find(PageKey(fileId, pid));
+  if (it != history.end()) {
+    hist1[frame] = it->second.first;
+    past.erase(it->second.second);
+    history.erase(it);
+  }
+  // a page read ahead is not referenced until it is used
+  if (prefetch) {
+    hist2[frame] = hist1[frame];
+    hist1[frame] = clock;
+    unused[frame] = true;
+  } else {
+    lastFrame = -1;
+    reference(frame);
+  }
+
+  order.insert(rank(frame));
+}
+
+void Lru2Policy::access(int frame)
+{
+  if (frame == lastFrame) return;
+
+  // the first use of a page read ahead takes the place of its load
+  order.erase(rank(frame));
+  if (unused[frame]) {
+    unused[frame] = false;
+    hist1[frame] = ++clock;
+    lastFrame = frame;
+  } else {
+    reference(frame);
+  }
+  order.insert(rank(frame));
+}
+
+void Lru2Policy::remove(int frame, int fileId, PageId pid, bool evicted)
+{
+  // remember when an evicted page was referenced last, forgetting the
+  // oldest pages
+  if (evicted) {
+    PageKey key(fileId, pid);
+    if (history.find(key) == history.end()) {
+      past.push_front(key);
+      history[key] = std::make_pair(hist1[frame], past.begin());
+      if ((int) past.size() > retain) {
+        history.erase(past.back());
+        past.pop_back();
+      }
+    }
+  }
+
+  order.erase(rank(frame));
+  hist1[frame] = -1;
+  hist2[frame] = -1;
+  unused[frame] = false;
+  if (lastFrame == frame) lastFrame = -1;
+  order.insert(rank(frame));
+}
+
+int Lru2Policy::first() const
+{
+  return order.empty() ? -1 : order.begin()->second;
+}
+
+int Lru2Policy::next(int frame) const
+{
+  std::set<Order>::const_iterator it = order.find(rank(frame));
+  if (it == order.end() || ++it == order.end()) return -1;
+  return it->second;
+}
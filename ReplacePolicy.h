@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef REPLACEPOLICY_H
+#define REPLACEPOLICY_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "PageFile.h"
+
+/**
+ * decides which frame of the buffer pool is reused next.
+ * the pool reports every page it loads, accesses and drops, and asks
+ * for the frames in the order in which they should be evicted, skipping
+ * the ones it cannot evict right now.
+ * the pool serializes all calls, so a policy needs no locking of its own.
+ */
+class ReplacePolicy {
+ public:
+  virtual ~ReplacePolicy() {}
+
+  /**
+   * create a policy for a pool whose frames are all empty.
+   * @param name[IN] "lru", "2q" or "lru2"
+   * @param count[IN] # of frames in the pool
+   * @return the new policy. NULL if the name is unknown
+   */
+  static ReplacePolicy* create(const std::string& name, int count);
+
+  /**
+   * @return true if create() knows the policy
+   */
+  static bool isValid(const std::string& name);
+
+  /**
+   * the page (fileId, pid) was placed in an empty frame.
+   * @param prefetch[IN] true if the page was read ahead and has not
+   *                     been used yet
+   */
+  virtual void load(int frame, int fileId, PageId pid, bool prefetch) = 0;
+
+  /**
+   * the page cached in the frame was used again.
+   */
+  virtual void access(int frame) = 0;
+
+  /**
+   * the page (fileId, pid) was removed from the frame, which is empty now.
+   * @param evicted[IN] true if the page made room for another page,
+   *                    false if it was dropped because it was stale
+   */
+  virtual void remove(int frame, int fileId, PageId pid, bool evicted) = 0;
+
+  /**
+   * @return the frame to evict first. -1 if there is none
+   */
+  virtual int first() const = 0;
+
+  /**
+   * @return the frame to evict after the given one. -1 if there is none
+   */
+  virtual int next(int frame) const = 0;
+
+ protected:
+  //
+  // doubly-linked lists of frames. a frame is on at most one list,
+  // and the head of a list is its most recently added frame.
+  //
+  struct FrameList {
+    int head;  // the most recently added frame (-1: empty)
+    int tail;  // the least recently added frame (-1: empty)
+    int size;  // # of frames on the list
+  };
+
+  std::vector<int> prevFrame;  // the frame before each frame on its list
+  std::vector<int> nextFrame;  // the frame after each frame on its list
+
+  void initList(FrameList& list, int count);
+  void pushFront(FrameList& list, int frame);
+  void pushBack(FrameList& list, int frame);
+  void unlink(FrameList& list, int frame);
+};
+
+/**
+ * evict the least recently used page.
+ */
+class LruPolicy : public ReplacePolicy {
+ public:
+  LruPolicy(int count);
+
+  void load(int frame, int fileId, PageId pid, bool prefetch);
+  void access(int frame);
+  void remove(int frame, int fileId, PageId pid, bool evicted);
+  int  first() const { return lru.tail; }
+  int  next(int frame) const { return prevFrame[frame]; }
+
+ private:
+  FrameList lru;  // all frames. empty frames are at the tail
+};
+
+/**
+ * the 2Q policy of Johnson and Shasha. a page read for the first time
+ * enters a FIFO queue (A1in), and only moves to the LRU queue (Am) if it
+ * is read again after it has been evicted from A1in, which a ghost queue
+ * of recently evicted pages (A1out) remembers. a single pass over a large
+ * file thus only cycles through A1in, and leaves the pages in Am, such
+ * as the upper levels of a B+tree, alone.
+ */
+class TwoQPolicy : public ReplacePolicy {
+ public:
+  TwoQPolicy(int count);
+
+  void load(int frame, int fileId, PageId pid, bool prefetch);
+  void access(int frame);
+  void remove(int frame, int fileId, PageId pid, bool evicted);
+  int  first() const;
+  int  next(int frame) const;
+
+ private:
+  enum { FREE, A1IN, AM };
+  typedef std::pair<int, PageId> PageKey;
+
+  int kin;    // A1in is evicted from first once it has more frames than this
+  int kout;   // max # of pages A1out remembers
+
+  FrameList lists[3];              // the FREE, A1IN and AM lists
+  std::vector<char> where;         // the list each frame is on
+
+  std::list<PageKey> a1out;        // the ghost queue, newest first
+  std::map<PageKey, std::list<PageKey>::iterator> ghosts;  // pages on A1out
+
+  /**
+   * @return the list to take frames from after the given one. -1 if none
+   */
+  int nextList(int list) const;
+};
+
+/**
+ * the LRU-K policy of O'Neil, O'Neil and Weikum with K = 2. a page is
+ * evicted by the time of its second most recent reference, and pages
+ * referenced only once go first, in LRU order. consecutive references
+ * to the same page, such as reading every tuple of a page in a scan,
+ * count as one. the last reference time of recently evicted pages is
+ * remembered, so a page read again soon after its eviction is known to
+ * be referenced twice.
+ */
+class Lru2Policy : public ReplacePolicy {
+ public:
+  Lru2Policy(int count);
+
+  void load(int frame, int fileId, PageId pid, bool prefetch);
+  void access(int frame);
+  void remove(int frame, int fileId, PageId pid, bool evicted);
+  int  first() const;
+  int  next(int frame) const;
+
+ private:
+  enum { FREE, ONCE, TWICE };
+  typedef std::pair<int, PageId> PageKey;
+  typedef std::pair<std::pair<int, long long>, int> Order;  // (rank, frame)
+
+  long long clock;  // advanced by every reference that is not correlated
+  int  lastFrame;   // the frame referenced last
+  int  retain;      // max # of evicted pages whose history is kept
+
+  std::vector<long long> hist1;  // the last reference time of each frame
+  std::vector<long long> hist2;  // the reference time before that (-1: none)
+  std::vector<char> unused;      // true for a page read ahead and not used yet
+  std::set<Order> order;         // all frames in eviction order
+
+  std::list<PageKey> past;       // the evicted pages with history, newest first
+  std::map<PageKey, std::pair<long long, std::list<PageKey>::iterator> >
+      history;                   // the last reference of each page on past
+
+  /**
+   * @return the rank of the frame in the eviction order
+   */
+  Order rank(int frame) const;
+
+  /**
+   * take a new reference to the page in the frame into account.
+   */
+  void reference(int frame);
+};
+
+#endif // REPLACEPOLICY_H
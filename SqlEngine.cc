@@ -13,6 +13,7 @@
 #include <iostream>
 #include <fstream>
 #include <limits.h>
+#include <algorithm>
 #include <set>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
@@ -25,6 +26,32 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+// # of tuples whose records are read from the table at once in an index scan
+static const int READ_BATCH = 64;
+
+// compare a value that is not zero-terminated with a string, like strcmp()
+static int compareValue(const char* value, int length, const char* str)
+{
+  int n = strlen(str);
+  int diff = memcmp(value, str, (length < n) ? length : n);
+  if (diff != 0) return diff;
+  return length - n;
+}
+
+// narrow the key conditions down to the keys from lo to hi, leaving out
+// the keys in ne. false if no key meets them
+static bool keyRange(const vector<SelCond>& cond, int& lo, int& hi, vector<int>& ne);
+
+// false if no tuple in the zone can meet the conditions, the key
+// conditions being narrowed down to the keys from lo to hi
+static bool inZone(const PageZone& zone, int lo, int hi, const vector<SelCond>& cond);
+
+// count, and print if attr is 1, the tuples that meet the conditions,
+// which are all on the key, by scanning only the keys of the table
+static RC scanKeys(const RecordFile& rf, int attr, const vector<SelCond>& cond, int& count);
+
+char SqlEngine::readMode = 'r';
+
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -43,7 +70,8 @@ RC SqlEngine::run(FILE* commandline)
 // 2 = value
 // 3 = *
 // 4 = COUNT(*)
-RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
+RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond,
+                     SelStats* stats)
 {
   RecordFile rf;   // RecordFile containing the table
   RecordId   rid;  // record cursor for table scanning
@@ -54,9 +82,12 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   string value;
   int    count;
   int    diff;
+  bool   indexUsed = false;  // true if the index file was opened
 
-  // open the table file
-  if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
+  if (stats != NULL) *stats = SelStats();
+
+  // open the table file. it is only read, so it may be mapped into memory
+  if ((rc = rf.open(table + ".tbl", readMode)) < 0) {
     return rc;
   }
 
@@ -302,6 +333,7 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     }
 
     if (contradiction) {
+      if (stats != NULL) stats->table = rf.getStats();
       rc = rf.close();
       // if (rc < 0) {
       //   return rc;
@@ -310,15 +342,57 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
     }
   }
 
-  rc = tree.open(table + ".idx", 'r');
+  rc = tree.open(table + ".idx", readMode);
+  indexUsed = (rc == 0);
 
   // do normal select routine if index file not found or if only NE is set
   if ((rc < 0) || ((!other_than_ne) && ne_set)){
-    // scan the table file from the beginning
-    while (rid < rf.endRid()) {
-      // read the tuple
-      if ((rc = rf.read(rid, key, value)) < 0) {
-        goto exit_select;
+    // the codes of the condition values in the dictionary of the page scanned
+    vector<int> codes(cond.size(), (int) RecordFile::NOT_CODED);
+    PageId      codePid = -1;
+    PageZone    zone;
+    int         lo, hi;
+    vector<int> ne;
+
+    // no tuple meets key conditions that contradict each other
+    if (!keyRange(cond, lo, hi, ne)) {
+      rc = 0;
+      goto end_scan;
+    }
+
+    // without conditions on the value, only the keys are needed
+    if (!valConds && (attr == 1 || attr == 4)) {
+      if ((rc = scanKeys(rf, attr, cond, count)) < 0) goto exit_select;
+      goto end_scan;
+    }
+
+    // scan the table file from the beginning, a page at a time.
+    // the values are looked at in the pages, without copying them.
+    // in a dictionary page, an EQ or NE condition on the value compares
+    // the code of the value with that of the condition value, which is
+    // looked up once per page. a page without the value of an EQ
+    // condition is skipped, and so is a page whose zone is out of the
+    // range of the conditions, before it is read.
+    RecordCursor scan;
+    const char*  val;
+    int          len;
+
+    rf.startScan(scan);
+    for (;;) {
+      while (rf.nextZone(scan, zone) && !inZone(zone, lo, hi, cond)) rf.skipZone(scan);
+      if ((rc = rf.readForward(scan, key, val, len)) < 0) break;
+
+      if (scan.rid.pid != codePid) {
+        codePid = scan.rid.pid;
+        for (unsigned i = 0; i < cond.size(); i++) {
+          if (cond[i].attr != 2) continue;
+          if (cond[i].comp != SelCond::EQ && cond[i].comp != SelCond::NE) continue;
+          codes[i] = rf.codeOf(scan, cond[i].value);
+          if (codes[i] == -1 && cond[i].comp == SelCond::EQ) {
+            rf.skipPage(scan);
+            goto next_tuple;
+          }
+        }
       }
 
       // check the conditions on the tuple
@@ -329,7 +403,8 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
             diff = key - atoi(cond[i].value);
             break;
           case 2:
-            diff = strcmp(value.c_str(), cond[i].value);
+            if (codes[i] != RecordFile::NOT_CODED) diff = (scan.code != codes[i]);
+            else diff = compareValue(val, len, cond[i].value);
             break;
         }
 
@@ -366,90 +441,124 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
           fprintf(stdout, "%d\n", key);
           break;
         case 2:  // SELECT value
-          fprintf(stdout, "%s\n", value.c_str());
+          fprintf(stdout, "%.*s\n", len, val);
           break;
         case 3:  // SELECT *
-          fprintf(stdout, "%d '%s'\n", key, value.c_str());
+          fprintf(stdout, "%d '%.*s'\n", key, len, val);
           break;
       }
 
       // move to the next tuple
       next_tuple:
-      ++rid;
+      ;
     }
+    rf.endScan(scan);
+
+    // the scan ends at the end of the file
+    if (rc != RC_NO_SUCH_RECORD) goto exit_select;
+    rc = 0;
+    end_scan:
+    ;
   } else { // we have an index, so use that
     IndexCursor c; // to iterate through tree
     c.eid = 0; // set default values
     c.pid = 1; // page 0 is index
-    // need to locate entry point into tree
-    if (k_eq_set) {
-      tree.locate(k_eq, c);
-    } else if (k_min_inclusive) {
-      tree.locate(k_min, c);
-    } else if (!k_min_inclusive) {
-      tree.locate(k_min + 1, c);
-    } else {
-      tree.locate(INT_MIN, c); // maybe start at 0?
+    // need to locate entry point into tree. the index cannot look up
+    // negative keys, so a scan without a lower bound or with a negative
+    // one starts at the leftmost leaf, wherever the allocator put it,
+    // and skips the keys below the bound
+    bool lowerSet = k_eq_set || !k_min_inclusive || k_min != INT_MIN;
+    int  lower = k_eq_set ? k_eq : (k_min_inclusive ? k_min : k_min + 1);
+    if (lowerSet && lower >= 0) {
+      tree.locate(lower, c);
+    } else if (tree.locateFirst(c) != 0) {
+      c.pid = -1; // the index is empty
     }
-    bool done = false, next_iteration = false;
-
-    // keep reading while there are elements and we haven't yet terminated
-    while (rc = tree.readForward(c, key, rid) == 0) {
-      // check if key is within bounds
-      if ((k_eq_set && key != k_eq) ||
-         (k_min_inclusive && key < k_min)  ||
-         (!k_min_inclusive && key <= k_min)  ||
-         (k_max_inclusive && key > k_max) ||
-         (!k_max_inclusive && key >= k_max)) {
-        break;
-      }
+    // the tuples that pass the key conditions are read from the table
+    // in batches, so that their pages are fetched from the disk together
+    RecordId rids[READ_BATCH];
+    int      keys[READ_BATCH];
+    string   values[READ_BATCH];
+    int      nrids;
+    bool     more = true;
+
+    while (more) {
+      // collect the next batch of tuples from the index
+      nrids = 0;
+      while (nrids < READ_BATCH) {
+        if (tree.readForward(c, key, rid) != 0) {
+          more = false;
+          break;
+        }
 
-      if (key_ne.find(key) != key_ne.end()) {
-        continue;
-      }
+        // check if key is within bounds. the keys come in order, so the
+        // scan ends at the first key past the upper bound
+        if ((k_eq_set && key > k_eq) ||
+           (k_max_inclusive && key > k_max) ||
+           (!k_max_inclusive && key >= k_max)) {
+          more = false;
+          break;
+        }
+        if ((k_eq_set && key < k_eq) ||
+           (k_min_inclusive && key < k_min)  ||
+           (!k_min_inclusive && key <= k_min)) {
+          continue;
+        }
 
-      // if there are no value conditions, and we don't need to print anything, we can just continue here
-      if (!valConds && attr == 4) {
-        count++;
+        if (key_ne.find(key) != key_ne.end()) {
+          continue;
+        }
+
+        // if there are no value conditions, and we don't need to print anything, we can just continue here
+        if (!valConds && attr == 4) {
+          count++;
+          continue;
+        }
+
+        rids[nrids++] = rid;
+      }
+      if (nrids == 0) {
         continue;
       }
-        
-      // read in value from record file
-      rc = rf.read(rid, key, value);
+
+      // read in values from record file
+      rc = rf.readMany(rids, nrids, keys, values);
       if (rc < 0) {
         break; // something went wrong
       }
 
-      const char* con_v = value.c_str();
+      for (int i = 0; i < nrids; i++) {
+        const char* con_v = values[i].c_str();
 
-      // check if value is within bounds
-      if ((v_eq_set && strcmp(con_v, v_eq.c_str()) != 0) ||
-         (v_min_set && v_min_inclusive && strcmp(con_v, v_min.c_str()) < 0)  ||
-         (v_min_set && !v_min_inclusive && strcmp(con_v, v_min.c_str()) <= 0)  ||
-         (v_max_set && v_max_inclusive && strcmp(con_v, v_max.c_str()) > 0) ||
-         (v_max_set && !v_max_inclusive && strcmp(con_v, v_max.c_str()) >= 0)) {
-	     continue;
-      }
+        // check if value is within bounds
+        if ((v_eq_set && strcmp(con_v, v_eq.c_str()) != 0) ||
+           (v_min_set && v_min_inclusive && strcmp(con_v, v_min.c_str()) < 0)  ||
+           (v_min_set && !v_min_inclusive && strcmp(con_v, v_min.c_str()) <= 0)  ||
+           (v_max_set && v_max_inclusive && strcmp(con_v, v_max.c_str()) > 0) ||
+           (v_max_set && !v_max_inclusive && strcmp(con_v, v_max.c_str()) >= 0)) {
+          continue;
+        }
 
-      // need to check that value is not within the NE variables
-      if (value_ne.find(value) != value_ne.end()) {
-        continue;
-      }
+        // need to check that value is not within the NE variables
+        if (value_ne.find(values[i]) != value_ne.end()) {
+          continue;
+        }
 
-      // the condition is met for the tuple. 
-      // increase matching tuple counter
-      count++;
-      // print the tuple 
-      switch (attr) {
-        case 1:  // SELECT key
-          fprintf(stdout, "%d\n", key);
-          break;
-        case 2:  // SELECT value
-          fprintf(stdout, "%s\n", value.c_str());
-          break;
-        case 3:  // SELECT *
-          fprintf(stdout, "%d '%s'\n", key, value.c_str());
-          break;
+        // the condition is met for the tuple. 
+        // increase matching tuple counter
+        count++;
+        // print the tuple 
+        switch (attr) {
+          case 1:  // SELECT key
+            fprintf(stdout, "%d\n", keys[i]);
+            break;
+          case 2:  // SELECT value
+            fprintf(stdout, "%s\n", values[i].c_str());
+            break;
+          case 3:  // SELECT *
+            fprintf(stdout, "%d '%s'\n", keys[i], values[i].c_str());
+            break;
+        }
       }
     }
 
@@ -468,6 +577,11 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 
   // close the table file and return
   exit_select:
+  if (stats != NULL) {
+    stats->table = rf.getStats();
+    stats->index = tree.getStats();
+    stats->indexUsed = indexUsed;
+  }
   rf.close();
   return rc;
 }
@@ -476,16 +590,12 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
 {
   /* your code here */
   RecordFile rf;   // RecordFile containing the table
-  RecordId   rid;  // record cursor for table scanning
   ifstream ifs; //input loadfile filestream
 
   //exit status variables
   RC     rc;
 
   //Insertion variables
-  int    key;     
-  string value;
-  int    count; //line number in load file
   string line;
   BTreeIndex btree;
 
@@ -509,35 +619,56 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
     return rc;
   }
 
-  //insert data 
-  while(! ifs.eof()) {
-    getline(ifs, line);
-    if(line == "")
-      break;
+  //insert data in batches. the tuples of a batch are appended to the
+  //table together, so that each page is written once per batch.
+  int      keys[LOAD_BATCH];
+  string   values[LOAD_BATCH];
+  RecordId rids[LOAD_BATCH];
+  bool     more = true;
+  while(more) {
+    int n = 0;
+    while(n < LOAD_BATCH) {
+      if(ifs.eof()) { more = false; break; }
+      getline(ifs, line);
+      if(line == "") { more = false; break; }
+
+      if((rc = parseLoadLine(line, keys[n], values[n])) < 0) {
+        rf.close();
+        ifs.close();
+        if(index){ btree.close();}
+        return rc;
+      }
+      n++;
+    }
+    if(n == 0) break;
 
-    if((rc = parseLoadLine(line, key, value)) < 0) {
+    if((rc = rf.appendBatch(keys, values, n, rids)) < 0) {
       rf.close();
       ifs.close();
       if(index){ btree.close();}
       return rc;
     }
 
-    if((rc = rf.append(key,value,rid)) < 0) {
-      rf.close();
-      ifs.close();
-      if(index){ btree.close();}
-      return rc;
+    for(int i = 0; index && i < n; i++) {
+      if((rc = btree.insert(keys[i], rids[i])) < 0) {
+        rf.close();
+        ifs.close();
+        btree.close();
+        return rc;
+      }
     }
 
-    if(index && (rc = btree.insert(key,rid)) < 0) {
+    // every batch of tuples and their index entries survive a crash
+    // together. the pages they share are logged only once.
+    if((rc = PageFile::commit()) < 0) {
       rf.close();
       ifs.close();
-      btree.close();
+      if(index){ btree.close();}
       return rc;
     }
-    count++;
   }
 
+  // the commits are synced when the files are closed
   rf.close();
   ifs.close();
   if (index) {
@@ -546,6 +677,13 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
   return 0;
 }
 
+RC SqlEngine::setReadMode(char mode)
+{
+  if (mode != 'm' && mode != 'r') return RC_INVALID_FILE_MODE;
+  readMode = mode;
+  return 0;
+}
+
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 {
     const char *s;
@@ -586,3 +724,103 @@ RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 
     return 0;
 }
+
+static bool keyRange(const vector<SelCond>& cond, int& lo, int& hi, vector<int>& ne)
+{
+  lo = INT_MIN;
+  hi = INT_MAX;
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 1) continue;
+    int v = atoi(cond[i].value);
+    switch (cond[i].comp) {
+      case SelCond::EQ:
+        lo = max(lo, v);
+        hi = min(hi, v);
+        break;
+      case SelCond::NE:
+        ne.push_back(v);
+        break;
+      case SelCond::GT:
+        if (v == INT_MAX) return false;
+        lo = max(lo, v + 1);
+        break;
+      case SelCond::LT:
+        if (v == INT_MIN) return false;
+        hi = min(hi, v - 1);
+        break;
+      case SelCond::GE:
+        lo = max(lo, v);
+        break;
+      case SelCond::LE:
+        hi = min(hi, v);
+        break;
+    }
+  }
+  return lo <= hi;
+}
+
+static RC scanKeys(const RecordFile& rf, int attr, const vector<SelCond>& cond, int& count)
+{
+  RC  rc;
+  int lo, hi, n;
+  vector<int> ne;
+  vector<int> keys(rf.getRecordsPerPage());
+  RecordCursor scan;
+  PageZone zone;
+
+  if (!keyRange(cond, lo, hi, ne)) return 0;
+
+  rf.startScan(scan);
+  for (;;) {
+    while (rf.nextZone(scan, zone) && !inZone(zone, lo, hi, cond)) rf.skipZone(scan);
+    if ((rc = rf.readKeys(scan, &keys[0], n)) < 0) break;
+
+    // counting keys in a range needs no branches, and can be vectorized
+    if (attr == 4 && ne.empty()) {
+      for (int j = 0; j < n; j++) count += (keys[j] >= lo) & (keys[j] <= hi);
+      continue;
+    }
+
+    for (int j = 0; j < n; j++) {
+      if (keys[j] < lo || keys[j] > hi) continue;
+      if (find(ne.begin(), ne.end(), keys[j]) != ne.end()) continue;
+      count++;
+      if (attr == 1) fprintf(stdout, "%d\n", keys[j]);
+    }
+  }
+  rf.endScan(scan);
+
+  return (rc == RC_NO_SUCH_RECORD) ? 0 : rc;
+}
+
+static bool inZone(const PageZone& zone, int lo, int hi, const vector<SelCond>& cond)
+{
+  char cut[ZONE_PREFIX];
+
+  if (zone.maxKey < lo || zone.minKey > hi) return false;
+
+  // a value is in the zone only if its first bytes are, and the
+  // condition value is cut the same way to compare with them
+  for (unsigned i = 0; i < cond.size(); i++) {
+    if (cond[i].attr != 2) continue;
+    strncpy(cut, cond[i].value, ZONE_PREFIX);
+    int belowMin = memcmp(cut, zone.minValue, ZONE_PREFIX) < 0;
+    int aboveMax = memcmp(cut, zone.maxValue, ZONE_PREFIX) > 0;
+    switch (cond[i].comp) {
+      case SelCond::EQ:
+        if (belowMin || aboveMax) return false;
+        break;
+      case SelCond::GT:
+      case SelCond::GE:
+        if (aboveMax) return false;
+        break;
+      case SelCond::LT:
+      case SelCond::LE:
+        if (belowMin) return false;
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
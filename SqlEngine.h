@@ -23,6 +23,15 @@ struct SelCond {
   char* value;  // the value to compare
 };
 
+/**
+ * the I/O done by a SELECT, separately for the table and its index
+ */
+struct SelStats {
+  IoStats table;      // the I/O on the table file
+  IoStats index;      // the I/O on the index file. zero if it was not used
+  bool    indexUsed;  // true if the index file was opened and read
+};
+
 /**
  * the class that takes, parses, and executes the user commands.
  */
@@ -46,9 +55,11 @@ class SqlEngine {
    * (1: key, 2: value, 3: *, 4: count(*))
    * @param table[IN] the table name in the FROM clause
    * @param conds[IN] list of conditions in the WHERE clause
+   * @param stats[OUT] if not NULL, receives the I/O done by the SELECT
    * @return error code. 0 if no error
    */
-  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
+  static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds,
+                   SelStats* stats = NULL);
 
   /**
    * load a table from a load file.
@@ -67,6 +78,21 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+  /**
+   * choose how SELECT opens the table and index files.
+   * @param mode[IN] 'r' to read them through the buffer pool (the default),
+   *                 'm' to map them into memory
+   * @return error code. 0 if no error
+   */
+  static RC setReadMode(char mode);
+
+ private:
+  static char readMode;  // the mode in which SELECT opens its files
+
+  // # of tuples LOAD appends to the table together, and commits
+  // together when the writes are logged
+  static const int LOAD_BATCH = 1024;
 };
 
 #endif /* SQLENGINE_H */
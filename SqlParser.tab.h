@@ -0,0 +1,109 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+#ifndef YY_SQL_SQLPARSER_TAB_H_INCLUDED
+# define YY_SQL_SQLPARSER_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
+#endif
+#if YYDEBUG
+extern int sqldebug;
+#endif
+
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    SELECT = 258,                  /* SELECT  */
+    FROM = 259,                    /* FROM  */
+    WHERE = 260,                   /* WHERE  */
+    LOAD = 261,                    /* LOAD  */
+    WITH = 262,                    /* WITH  */
+    INDEX = 263,                   /* INDEX  */
+    QUIT = 264,                    /* QUIT  */
+    COUNT = 265,                   /* COUNT  */
+    AND = 266,                     /* AND  */
+    OR = 267,                      /* OR  */
+    COMMA = 268,                   /* COMMA  */
+    STAR = 269,                    /* STAR  */
+    LF = 270,                      /* LF  */
+    INTEGER = 271,                 /* INTEGER  */
+    STRING = 272,                  /* STRING  */
+    ID = 273,                      /* ID  */
+    EQUAL = 274,                   /* EQUAL  */
+    NEQUAL = 275,                  /* NEQUAL  */
+    LESS = 276,                    /* LESS  */
+    LESSEQUAL = 277,               /* LESSEQUAL  */
+    GREATER = 278,                 /* GREATER  */
+    GREATEREQUAL = 279             /* GREATEREQUAL  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
+
+/* Value type.  */
+#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
+union YYSTYPE
+{
+#line 109 "SqlParser.y"
+
+  int integer;
+  char* string;
+  SelCond* cond;
+  std::vector<SelCond>* conds;
+
+#line 95 "SqlParser.tab.h"
+
+};
+typedef union YYSTYPE YYSTYPE;
+# define YYSTYPE_IS_TRIVIAL 1
+# define YYSTYPE_IS_DECLARED 1
+#endif
+
+
+extern YYSTYPE sqllval;
+
+
+int sqlparse (void);
+
+
+#endif /* !YY_SQL_SQLPARSER_TAB_H_INCLUDED  */
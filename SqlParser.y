@@ -8,24 +8,69 @@
 #include "Bruinbase.h"
 #include "SqlEngine.h" 
 #include "PageFile.h"
+#include "WriteAheadLog.h"
 
 int  sqllex(void);  
 void sqlerror(const char *str) { fprintf(stderr, "Error: %s\n", str); }
 extern "C" { int  sqlwrap() { return 1; } }
 
+static void printStats(const char* name, const IoStats& s)
+{
+  fprintf(stderr, "     %s: %lld pages read (%lld bytes) in %lld syscalls, "
+          "%lld hits, %lld misses, %lld evictions, %lld bytes copied",
+          name, s.pageReads, s.bytesRead, s.syscalls,
+          s.hits, s.misses, s.evictions, s.bytesCopied);
+  if (s.latencyBound(1.0) > 0) {
+    fprintf(stderr, ", read latency p50 < %lldus p99 < %lldus",
+            s.latencyBound(0.5), s.latencyBound(0.99));
+  }
+  fprintf(stderr, "\n");
+}
+
 static void runSelect(int attr, const char* table, const std::vector<SelCond>& conds)
 {
   struct tms tmsbuf;
   clock_t btime, etime;
-  int     bpagecnt, epagecnt;
+  IoStats btotal, etotal;
+  SelStats stats;
 
   btime = times(&tmsbuf);
-  bpagecnt = PageFile::getPageReadCount();
-  SqlEngine::select(attr, table, conds);
+  btotal = PageFile::getTotalStats();
+  SqlEngine::select(attr, table, conds, &stats);
   etime = times(&tmsbuf);
-  epagecnt = PageFile::getPageReadCount();
+  etotal = PageFile::getTotalStats();
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %lld pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), (etotal - btotal).pageReads);
+  printStats("table", stats.table);
+  if (stats.indexUsed) printStats("index", stats.index);
+  fprintf(stderr, "     pool: %d pages in %s\n", PageFile::getCacheSize(), PageFile::getPoolMemory());
+}
+
+static void runLoad(const char* table, const char* loadfile, bool index)
+{
+  struct tms tmsbuf;
+  clock_t btime, etime;
+  IoStats btotal, etotal;
+  const WriteAheadLog* log = PageFile::getLog();
+  long long bcommits = 0, bwrites = 0, bsyncs = 0;
+
+  btime = times(&tmsbuf);
+  btotal = PageFile::getTotalStats();
+  if (log != NULL) {
+    bcommits = log->getCommitCount();
+    bwrites = log->getWriteCount();
+    bsyncs = log->getSyncCount();
+  }
+  SqlEngine::load(table, loadfile, index);
+  etime = times(&tmsbuf);
+  etotal = PageFile::getTotalStats();
+
+  fprintf(stderr, "  -- %.3f seconds to run the load command. Wrote %lld pages in %lld syscalls\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), (etotal - btotal).pageWrites, (etotal - btotal).syscalls);
+  if (log != NULL) {
+    fprintf(stderr, "     log: %lld commits, %lld writes, %lld syncs\n",
+            log->getCommitCount() - bcommits, log->getWriteCount() - bwrites,
+            log->getSyncCount() - bsyncs);
+  }
 }
 
 %}
@@ -67,12 +112,12 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  runLoad($2, $4, false); 
 	  free($2);
 	  free($4);
 	}
 	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	  runLoad($2, $4, true); 
 	  free($2);
 	  free($4);
 	}
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// load a table of a given size with an index on its keys, and then look
+// up random keys through the index, checking every record found.
+// the table may start at a high page id, past a hole in the file, to
+// try page ids that do not fit in 32 bits without writing terabytes.
+//
+// usage: tablebench [gigabytes] [first_pid] [lookups]
+//
+
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+using std::string;
+
+static const char* TABLE_FILE = "tablebench.tbl";
+static const char* INDEX_FILE = "tablebench.idx";
+
+// @return the seconds since begin
+static double since(const struct timespec& begin)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - begin.tv_sec) + (now.tv_nsec - begin.tv_nsec) / 1e9;
+}
+
+// @return the value stored with the key
+static string valueOf(int key)
+{
+  char value[RecordFile::MAX_VALUE_LENGTH];
+  snprintf(value, sizeof(value), "record %d of the table benchmark", key);
+  return value;
+}
+
+int main(int argc, char* argv[])
+{
+  double gigabytes = (argc > 1) ? atof(argv[1]) : 10;
+  PageId firstPid = (argc > 2) ? atoll(argv[2]) : 0;
+  int lookups = (argc > 3) ? atoi(argv[3]) : 100000;
+  if (gigabytes <= 0 || firstPid < 0 || lookups <= 0) {
+    fprintf(stderr, "usage: %s [gigabytes] [first_pid] [lookups]\n", argv[0]);
+    return 1;
+  }
+
+  RecordFile rf;
+  BTreeIndex tree;
+  RecordId rid;
+  RC rc;
+
+  unlink(TABLE_FILE);
+  unlink(INDEX_FILE);
+
+  // leave a hole before the first page of the table, which is made
+  // to look like a full legacy page so that the table goes on after it
+  if (firstPid > 0) {
+    PageFile pf;
+    char page[PageFile::MAX_PAGE_SIZE];
+    memset(page, 0, sizeof(page));
+    if (pf.open(TABLE_FILE, 'w') < 0) {
+      fprintf(stderr, "cannot create %s\n", TABLE_FILE);
+      return 1;
+    }
+    int full = (pf.getPageSize() - sizeof(int)) / (sizeof(int) + RecordFile::MAX_VALUE_LENGTH);
+    memcpy(page, &full, sizeof(int));
+    if (pf.write(firstPid - 1, page) < 0 || pf.close() < 0) {
+      fprintf(stderr, "cannot create %s\n", TABLE_FILE);
+      return 1;
+    }
+  }
+
+  if (rf.open(TABLE_FILE, 'w') < 0 || tree.open(INDEX_FILE, 'w') < 0) {
+    fprintf(stderr, "cannot create %s or %s\n", TABLE_FILE, INDEX_FILE);
+    return 1;
+  }
+
+  // load the table, in the order of the keys
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  long long bytes = (long long) (gigabytes * (1 << 30));
+  long long target = firstPid + bytes / PageFile::getDefaultPageSize();
+  int keys = 0;
+  while (rf.endRid().pid < target) {
+    if ((rc = rf.append(keys, valueOf(keys), rid)) < 0 || (rc = tree.insert(keys, rid)) < 0) {
+      fprintf(stderr, "cannot load key %d: error %d\n", keys, rc);
+      return 1;
+    }
+    keys++;
+  }
+  PageId lastPid = rid.pid;
+  if (rf.close() < 0 || tree.close() < 0) {
+    fprintf(stderr, "cannot close the table\n");
+    return 1;
+  }
+  double seconds = since(begin);
+  printf("loaded %d records in %.1f s, %.1f MB/s. pages %lld to %lld\n", keys, seconds,
+         (lastPid - firstPid + 1) * (double) PageFile::getDefaultPageSize() / (1 << 20) / seconds,
+         firstPid, lastPid);
+
+  // look up random keys. the pages come from all over the file.
+  if (rf.open(TABLE_FILE, 'r') < 0 || tree.open(INDEX_FILE, 'r') < 0) {
+    fprintf(stderr, "cannot open the table\n");
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  unsigned seed = 1;
+  int wrong = 0;
+  for (int i = 0; i < lookups; i++) {
+    int searchKey = (int) (((long long) rand_r(&seed) * (RAND_MAX + 1LL) + rand_r(&seed)) % keys);
+    IndexCursor cursor;
+    int key;
+    string value;
+    if (tree.locate(searchKey, cursor) < 0 || tree.readForward(cursor, key, rid) < 0 ||
+        rf.read(rid, key, value) < 0 || key != searchKey || value != valueOf(searchKey)) {
+      wrong++;
+    }
+  }
+  seconds = since(begin);
+  printf("%d lookups in %.1f s, %.0f lookups/s, %d wrong\n", lookups, seconds,
+         lookups / seconds, wrong);
+
+  rf.close();
+  tree.close();
+  unlink(TABLE_FILE);
+  unlink(INDEX_FILE);
+  unlink((string(TABLE_FILE) + ".hot").c_str());
+  unlink((string(INDEX_FILE) + ".hot").c_str());
+  unlink((string(TABLE_FILE) + ".zone").c_str());
+  return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// measure the point lookups in a B+tree index that is cached in a large
+// buffer pool, with the pool in normal pages and in huge pages, and
+// count the data TLB misses of each with a hardware counter.
+//
+// usage: tlbbench [keys] [lookups]
+//
+
+#include "Bruinbase.h"
+#include "BTreeIndex.h"
+#include "PageFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using std::vector;
+
+static const char* INDEX_FILE = "tlbbench.idx";
+
+// open a counter of the data TLB load misses of this process.
+// @return the file descriptor of the counter. -1 if the CPU or the
+//         kernel does not count them
+static int openTlbCounter()
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// look up random keys in the index.
+// @param misses[OUT] the # of dTLB load misses of the lookups. -1 if they are not counted
+// @return the # of lookups per second. -1 if a lookup did not find its key
+static double measure(BTreeIndex& tree, int keyCount, int lookups, long long& misses)
+{
+  struct timespec begin, end;
+  IndexCursor cursor;
+  RecordId rid;
+  int key;
+  unsigned seed = 1;
+  long long before = 0, after = 0;
+
+  int fd = openTlbCounter();
+  if (fd >= 0 && read(fd, &before, sizeof(before)) != sizeof(before)) {
+    close(fd);
+    fd = -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int i = 0; i < lookups; i++) {
+    int searchKey = rand_r(&seed) % keyCount;
+    if (tree.locate(searchKey, cursor) < 0 ||
+        tree.readForward(cursor, key, rid) < 0 || key != searchKey || rid.pid != searchKey) {
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  misses = -1;
+  if (fd >= 0) {
+    if (read(fd, &after, sizeof(after)) == sizeof(after)) misses = after - before;
+    close(fd);
+  }
+
+  return lookups / ((end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
+}
+
+int main(int argc, char* argv[])
+{
+  int keyCount = (argc > 1) ? atoi(argv[1]) : 1000000;
+  int lookups = (argc > 2) ? atoi(argv[2]) : 1000000;
+  if (keyCount <= 0 || lookups <= 0) {
+    fprintf(stderr, "usage: %s [keys] [lookups]\n", argv[0]);
+    return 1;
+  }
+
+  // build the index with the keys in random order
+  BTreeIndex tree;
+  unlink(INDEX_FILE);
+  if (tree.open(INDEX_FILE, 'w') < 0) {
+    fprintf(stderr, "cannot create %s\n", INDEX_FILE);
+    return 1;
+  }
+  vector<int> keys(keyCount);
+  for (int i = 0; i < keyCount; i++) keys[i] = i;
+  unsigned seed = 1;
+  for (int i = keyCount - 1; i > 0; i--) std::swap(keys[i], keys[rand_r(&seed) % (i + 1)]);
+  for (int i = 0; i < keyCount; i++) {
+    RecordId rid;
+    rid.pid = keys[i];
+    rid.sid = 0;
+    if (tree.insert(keys[i], rid) < 0) {
+      fprintf(stderr, "cannot insert key %d\n", keys[i]);
+      return 1;
+    }
+  }
+  tree.close();
+
+  // the whole index fits in the pool, so every lookup only hits
+  PageFile probe;
+  probe.open(INDEX_FILE, 'r');
+  int pages = (int) probe.endPid();
+  probe.close();
+  if (PageFile::getCacheSize() < 2 * pages &&
+      PageFile::setCacheSize(2 * pages) < 0) {
+    fprintf(stderr, "cannot allocate a buffer pool of %d pages\n", 2 * pages);
+    return 1;
+  }
+
+  printf("%d keys, %d index pages, a pool of %d pages\n", keyCount, pages,
+         PageFile::getCacheSize());
+  bool counted = true;
+  for (int huge = 0; huge <= 1; huge++) {
+    long long misses;
+    if (PageFile::setHugePages(huge) < 0 || tree.open(INDEX_FILE, 'r') < 0) {
+      fprintf(stderr, "cannot open %s\n", INDEX_FILE);
+      return 1;
+    }
+    measure(tree, keyCount, keyCount, misses);  // load the whole index into the pool
+    double rate = measure(tree, keyCount, lookups, misses);
+    tree.close();
+    if (rate < 0) {
+      fprintf(stderr, "a lookup returned a wrong entry\n");
+      return 1;
+    }
+
+    printf("%-22s  %10.0f lookups/s", PageFile::getPoolMemory(), rate);
+    if (misses >= 0) printf("  %8.3f dTLB load misses/lookup", (double) misses / lookups);
+    else counted = false;
+    printf("\n");
+  }
+  if (!counted) printf("dTLB load misses are not available: the CPU or the kernel does not count them\n");
+
+  unlink(INDEX_FILE);
+  unlink((std::string(INDEX_FILE) + ".hot").c_str());
+  return 0;
+}
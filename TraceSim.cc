@@ -0,0 +1,194 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// replay a page access trace, written by bruinbase -T, against buffer
+// pools of doubling sizes under every replacement policy, and print the
+// read hit ratio of each. the pool is simulated the way PageFile runs
+// it: a page read or written takes a frame, and a frame is freed in the
+// order of the policy. the pages the pool would read ahead are not in
+// the trace, so the ratios are those without read-ahead.
+//
+// usage: tracesim trace_file [max_pages]
+//
+
+#include "Bruinbase.h"
+#include "PageTrace.h"
+#include "ReplacePolicy.h"
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+static const char* POLICIES[] = { "lru", "2q", "lru2" };
+static const int POLICY_COUNT = sizeof(POLICIES) / sizeof(POLICIES[0]);
+static const int MIN_PAGES = 16;  // the smallest pool simulated
+
+struct Access {
+  int  page;   // the page accessed, numbered from 0 in order of first access
+  bool write;  // true if the page was written
+};
+
+typedef std::pair<int, PageId> PageKey;  // (file id, pid)
+
+static vector<Access>  accesses;  // the trace
+static vector<PageKey> pages;     // the file id and pid of every page
+
+/**
+ * read the trace into accesses and pages.
+ * @param names[OUT] the name of each file id
+ * @param seconds[OUT] the time the trace spans
+ * @return error code. 0 if no error
+ */
+static RC readTrace(const char* filename, map<int, string>& names, double& seconds)
+{
+  FILE* f = fopen(filename, "rb");
+  if (f == NULL) return RC_FILE_OPEN_FAILED;
+
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC ||
+      header.version != TRACE_VERSION) {
+    fclose(f);
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  map<PageKey, int> numbers;  // the number of every page seen so far
+  TraceRecord rec;
+  long long micros = 0;
+  RC rc = 0;
+  while (rc == 0 && fread(&rec, sizeof(rec), 1, f) == 1) {
+    micros += rec.delta;
+    if (rec.op == TRACE_FILE) {
+      // the name follows, padded to a whole record
+      if (rec.pid < 0 || rec.pid > 4096) { rc = RC_INVALID_FILE_FORMAT; break; }
+      size_t padded = (rec.pid + sizeof(rec) - 1) / sizeof(rec) * sizeof(rec);
+      vector<char> name(padded + 1, 0);
+      if (padded > 0 && fread(&name[0], padded, 1, f) != 1) { rc = RC_INVALID_FILE_FORMAT; break; }
+      names[rec.file] = string(&name[0], rec.pid);
+    } else if (rec.op == TRACE_READ || rec.op == TRACE_WRITE) {
+      PageKey key(rec.file, rec.pid);
+      map<PageKey, int>::iterator it = numbers.find(key);
+      if (it == numbers.end()) {
+        it = numbers.insert(std::make_pair(key, (int) pages.size())).first;
+        pages.push_back(key);
+      }
+      Access a;
+      a.page = it->second;
+      a.write = (rec.op == TRACE_WRITE);
+      accesses.push_back(a);
+    } else {
+      rc = RC_INVALID_FILE_FORMAT;
+    }
+  }
+  fclose(f);
+
+  seconds = micros / 1e6;
+  return rc;
+}
+
+/**
+ * replay the trace against a pool.
+ * @param policyName[IN] the replacement policy of the pool
+ * @param frames[IN] # of frames in the pool
+ * @return the # of reads that hit the pool
+ */
+static long long simulate(const char* policyName, int frames)
+{
+  ReplacePolicy* policy = ReplacePolicy::create(policyName, frames);
+  vector<int> frameOf(pages.size(), -1);  // the frame of each page. -1 if not cached
+  vector<int> pageIn(frames, -1);         // the page in each frame. -1 if empty
+  long long hits = 0;
+
+  for (size_t i = 0; i < accesses.size(); i++) {
+    int page = accesses[i].page;
+    int frame = frameOf[page];
+    if (frame >= 0) {
+      policy->access(frame);
+      if (!accesses[i].write) hits++;
+      continue;
+    }
+
+    // the pool takes the first frame in the order of the policy,
+    // which comes up with the empty frames first
+    frame = policy->first();
+    int old = pageIn[frame];
+    if (old >= 0) {
+      policy->remove(frame, pages[old].first, pages[old].second, true);
+      frameOf[old] = -1;
+    }
+    policy->load(frame, pages[page].first, pages[page].second, false);
+    frameOf[page] = frame;
+    pageIn[frame] = page;
+  }
+
+  delete policy;
+  return hits;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2 || argc > 3 || (argc == 3 && atoi(argv[2]) <= 0)) {
+    fprintf(stderr, "usage: %s trace_file [max_pages]\n", argv[0]);
+    return 1;
+  }
+
+  map<int, string> names;
+  double seconds;
+  RC rc = readTrace(argv[1], names, seconds);
+  if (rc < 0) {
+    fprintf(stderr, "cannot read the trace %s: error %d\n", argv[1], rc);
+    return 1;
+  }
+
+  long long reads = 0;
+  vector<int> filePages;  // # of pages of each file id
+  for (size_t i = 0; i < accesses.size(); i++) {
+    if (!accesses[i].write) reads++;
+  }
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (pages[i].first >= (int) filePages.size()) filePages.resize(pages[i].first + 1, 0);
+    filePages[pages[i].first]++;
+  }
+
+  printf("%s: %lu accesses (%lld reads, %lld writes) to %lu pages over %.1f s\n", argv[1],
+         (unsigned long) accesses.size(), reads, (long long) accesses.size() - reads,
+         (unsigned long) pages.size(), seconds);
+  for (size_t id = 0; id < filePages.size(); id++) {
+    if (filePages[id] == 0) continue;
+    printf("  %s: %d pages\n", names.count(id) ? names[id].c_str() : "(unnamed)", filePages[id]);
+  }
+  if (reads == 0) return 0;
+
+  // the pools double in size until every page fits
+  int maxPages = (argc == 3) ? atoi(argv[2]) : (int) pages.size();
+  if (maxPages > (int) pages.size()) maxPages = pages.size();
+  vector<int> sizes;
+  for (int size = MIN_PAGES; size < maxPages; size *= 2) sizes.push_back(size);
+  sizes.push_back(maxPages);
+
+  printf("\nread hit ratio by # of pages in the pool\n");
+  printf("%9s", "pages");
+  for (int p = 0; p < POLICY_COUNT; p++) printf("  %7s", POLICIES[p]);
+  printf("\n");
+  for (size_t s = 0; s < sizes.size(); s++) {
+    printf("%9d", sizes[s]);
+    for (int p = 0; p < POLICY_COUNT; p++) {
+      printf("  %6.2f%%", 100.0 * simulate(POLICIES[p], sizes[s]) / reads);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,293 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#include "Bruinbase.h"
+#include "WriteAheadLog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::map;
+using std::string;
+using std::vector;
+
+//
+// the log is a sequence of records, each a header followed by a payload.
+// a FILE record names a file, a PAGE record holds the new content of a page
+// of a named file, and a COMMIT record ends an update. the checksum lets
+// recovery tell where the records written before a crash end.
+//
+enum { LOG_FILE = 1, LOG_PAGE = 2, LOG_COMMIT = 3 };
+
+struct LogRecord {
+  int       type;      // LOG_FILE, LOG_PAGE or LOG_COMMIT
+  int       file;      // the number of the file the record is about
+  int       length;    // # of bytes of the payload
+  unsigned  checksum;  // of the header, with this field set to 0, and the payload
+  long long offset;    // the file offset of the page of a PAGE record
+};
+
+// compute the checksum of a record
+static unsigned checksum(const LogRecord& rec, const char* payload);
+
+// mix the bytes of the data into the hash value
+static unsigned hashWords(unsigned h, const char* data, int length);
+
+// write the whole buffer to the file at the offset
+static bool writeFully(int fd, const char* data, size_t length, off_t offset);
+
+WriteAheadLog::WriteAheadLog()
+{
+  fd = -1;
+  written = 0;
+  synced = 0;
+  committed = 0;
+  writes = 0;
+  syncs = 0;
+  commits = 0;
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  if (fd >= 0) ::close(fd);
+}
+
+RC WriteAheadLog::open(const string& filename)
+{
+  RC rc;
+
+  if (fd >= 0) return RC_FILE_OPEN_FAILED;
+
+  fd = ::open(filename.c_str(), O_RDWR|O_CREAT, 0644);
+  if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
+
+  // finish the updates that were committed before a crash
+  if ((rc = recover()) < 0 || (rc = reset()) < 0) {
+    ::close(fd);
+    fd = -1;
+    return rc;
+  }
+  return 0;
+}
+
+int WriteAheadLog::addFile(const string& filename)
+{
+  map<string, int>::iterator it = files.find(filename);
+  if (it != files.end()) return it->second;
+
+  int file = files.size();
+  files[filename] = file;
+  appendRecord(LOG_FILE, file, 0, filename.c_str(), filename.size());
+  return file;
+}
+
+off_t WriteAheadLog::append(int file, off_t offset, const void* data, int length, off_t last)
+{
+  // an image logged since the last commit and still in the buffer
+  // can be overwritten, as it has not reached the disk
+  if (last >= committed && last >= written + (off_t) sizeof(LogRecord)) {
+    LogRecord rec;
+    char* header = &buffer[last - written - sizeof(rec)];
+    memcpy(&rec, header, sizeof(rec));
+    if (rec.type == LOG_PAGE && rec.file == file && rec.offset == offset &&
+        rec.length == length) {
+      memcpy(header + sizeof(rec), data, length);
+      rec.checksum = checksum(rec, (const char*) data);
+      memcpy(header, &rec, sizeof(rec));
+      return last;
+    }
+  }
+
+  return appendRecord(LOG_PAGE, file, offset, data, length);
+}
+
+RC WriteAheadLog::commit()
+{
+  off_t rc = appendRecord(LOG_COMMIT, -1, 0, NULL, 0);
+  if (rc < 0) return rc;
+  commits++;
+  committed = size();
+
+  // the commits since the last sync become durable together
+  if (committed - synced >= GROUP_BYTES) return sync();
+  return 0;
+}
+
+RC WriteAheadLog::sync()
+{
+  RC rc;
+
+  if ((rc = writeOut(size())) < 0) return rc;
+  if (synced == written) return 0;
+
+  if (::fdatasync(fd) < 0) return RC_FILE_WRITE_FAILED;
+  syncs++;
+  synced = written;
+  return 0;
+}
+
+RC WriteAheadLog::writeOut(off_t end)
+{
+  if (end <= written || buffer.empty()) return 0;
+
+  // the buffer is always written as a whole, so a record never
+  // straddles the end of the log file
+  if (!writeFully(fd, &buffer[0], buffer.size(), written)) return RC_FILE_WRITE_FAILED;
+  writes++;
+  written += buffer.size();
+  buffer.clear();
+  return 0;
+}
+
+RC WriteAheadLog::read(off_t offset, void* data, int length) const
+{
+  // the data may still be in the buffer
+  if (offset >= written) {
+    if (offset + length > size()) return RC_FILE_READ_FAILED;
+    memcpy(data, &buffer[offset - written], length);
+    return 0;
+  }
+
+  if (::pread(fd, data, length, offset) != length) return RC_FILE_READ_FAILED;
+  return 0;
+}
+
+RC WriteAheadLog::reset()
+{
+  buffer.clear();
+  if (::ftruncate(fd, 0) < 0 || ::fdatasync(fd) < 0) return RC_FILE_WRITE_FAILED;
+  written = synced = committed = 0;
+
+  // files that are still open keep their numbers
+  for (map<string, int>::iterator it = files.begin(); it != files.end(); it++) {
+    appendRecord(LOG_FILE, it->second, 0, it->first.c_str(), it->first.size());
+  }
+  return 0;
+}
+
+off_t WriteAheadLog::appendRecord(int type, int file, off_t offset, const void* data, int length)
+{
+  RC rc;
+  LogRecord rec;
+
+  if (buffer.size() + sizeof(rec) + length > (size_t) BUFFER_SIZE &&
+      (rc = writeOut(size())) < 0) return rc;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = type;
+  rec.file = file;
+  rec.length = length;
+  rec.offset = offset;
+  rec.checksum = checksum(rec, (const char*) data);
+
+  const char* header = (const char*) &rec;
+  buffer.insert(buffer.end(), header, header + sizeof(rec));
+  if (length > 0) buffer.insert(buffer.end(), (const char*) data, (const char*) data + length);
+  return size() - length;
+}
+
+RC WriteAheadLog::recover()
+{
+  struct stat statbuf;
+  if (::fstat(fd, &statbuf) < 0) return RC_FILE_READ_FAILED;
+  if (statbuf.st_size == 0) return 0;
+
+  // the log is only as large as CHECKPOINT_SIZE and a bit, so read it whole
+  vector<char> log(statbuf.st_size);
+  if (::pread(fd, &log[0], log.size(), 0) != (ssize_t) log.size()) return RC_FILE_READ_FAILED;
+
+  map<int, string> names;   // the name of each file number
+  map<int, int> fds;        // the files opened to apply pages to
+  vector<size_t> pending;   // the PAGE records of the update being read
+  RC rc = 0;
+
+  // go through the records up to the first one that is incomplete or corrupt,
+  // which is where the log ended when the crash happened
+  size_t pos = 0;
+  while (rc == 0 && pos + sizeof(LogRecord) <= log.size()) {
+    LogRecord rec;
+    memcpy(&rec, &log[pos], sizeof(rec));
+    const char* payload = &log[pos + sizeof(rec)];
+    if (rec.length < 0 || pos + sizeof(rec) + rec.length > log.size() ||
+        rec.checksum != checksum(rec, payload)) break;
+
+    switch (rec.type) {
+    case LOG_FILE:
+      names[rec.file] = string(payload, rec.length);
+      break;
+    case LOG_PAGE:
+      pending.push_back(pos);
+      break;
+    case LOG_COMMIT:
+      // the update is complete. copy its pages to their files.
+      for (unsigned i = 0; rc == 0 && i < pending.size(); i++) {
+        LogRecord page;
+        memcpy(&page, &log[pending[i]], sizeof(page));
+        if (names.find(page.file) == names.end()) { rc = RC_INVALID_FILE_FORMAT; break; }
+        if (fds.find(page.file) == fds.end()) {
+          int f = ::open(names[page.file].c_str(), O_RDWR|O_CREAT, 0644);
+          if (f < 0) { rc = RC_FILE_OPEN_FAILED; break; }
+          fds[page.file] = f;
+        }
+        if (!writeFully(fds[page.file], &log[pending[i] + sizeof(page)],
+                        page.length, page.offset)) rc = RC_FILE_WRITE_FAILED;
+      }
+      pending.clear();
+      break;
+    default:
+      rc = RC_INVALID_FILE_FORMAT;
+      break;
+    }
+    pos += sizeof(rec) + rec.length;
+  }
+
+  // the pages must be durable before the log that holds them goes away
+  for (map<int, int>::iterator it = fds.begin(); it != fds.end(); it++) {
+    if (::fdatasync(it->second) < 0 && rc == 0) rc = RC_FILE_WRITE_FAILED;
+    ::close(it->second);
+  }
+  return rc;
+}
+
+static unsigned checksum(const LogRecord& rec, const char* payload)
+{
+  LogRecord copy = rec;
+  copy.checksum = 0;
+
+  // FNV-1a over the header and the payload, taken a word at a time.
+  // it only has to catch records torn by a crash.
+  unsigned h = 2166136261u;
+  h = hashWords(h, (const char*) &copy, sizeof(copy));
+  return hashWords(h, payload, rec.length);
+}
+
+static unsigned hashWords(unsigned h, const char* data, int length)
+{
+  int i = 0;
+  for (; i + (int) sizeof(unsigned) <= length; i += sizeof(unsigned)) {
+    unsigned w;
+    memcpy(&w, data + i, sizeof(w));
+    h = (h ^ w) * 16777619u;
+  }
+  for (; i < length; i++) h = (h ^ (unsigned char) data[i]) * 16777619u;
+  return h;
+}
+
+static bool writeFully(int fd, const char* data, size_t length, off_t offset)
+{
+  while (length > 0) {
+    ssize_t n = ::pwrite(fd, data, length, offset);
+    if (n <= 0) return false;
+    data += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
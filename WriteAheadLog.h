@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "Bruinbase.h"
+
+/**
+ * a redo log of page images.
+ * every page written to a logged file is appended to the log, and the
+ * pages written since the last commit become durable together once the
+ * commit reaches the disk. commits are grouped, so that many of them
+ * share one fsync(). after a crash, open() copies the pages of every
+ * committed group to their files and drops the rest, so a file never
+ * shows half of an update.
+ * the log does no locking. the buffer pool serializes all calls.
+ */
+class WriteAheadLog {
+ public:
+  static const int BUFFER_SIZE = 1 << 20;      // the log is written in chunks of up to 1MB
+  static const int GROUP_BYTES = 256 << 10;    // a commit syncs once this much is logged
+  static const off_t CHECKPOINT_SIZE = 64 << 20; // the log is checkpointed once this large
+
+  WriteAheadLog();
+  ~WriteAheadLog();
+
+  /**
+   * open the log file, creating it if it does not exist. if it holds
+   * committed pages from before a crash, they are first written to
+   * their files, and the log is emptied.
+   * @param filename[IN] the name of the log file
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename);
+
+  /**
+   * @return the number by which the log refers to the file. the first
+   *         call for a file since the log was last emptied logs its name
+   */
+  int addFile(const std::string& filename);
+
+  /**
+   * append the image of a page. if the page was already logged by the
+   * current update and that image has not been written out yet, it is
+   * replaced instead, so a page written many times by an update takes
+   * up the log only once.
+   * @param file[IN] the file of the page, as returned by addFile()
+   * @param offset[IN] the file offset of the page
+   * @param data[IN] the content of the page
+   * @param length[IN] the size of the page
+   * @param last[IN] the log offset of the last image of the page. -1 if none
+   * @return the log offset of the page content. an error code (< 0)
+   *         if the log could not be written
+   */
+  off_t append(int file, off_t offset, const void* data, int length, off_t last = -1);
+
+  /**
+   * end the current update. the pages logged since the previous commit
+   * are applied together after a crash, or not at all. the commit is
+   * only durable once the log is synced, which happens here as soon as
+   * GROUP_BYTES have been logged since the last sync.
+   * @return error code. 0 if no error
+   */
+  RC commit();
+
+  /**
+   * write the whole log to the disk and wait until it is durable.
+   * @return error code. 0 if no error
+   */
+  RC sync();
+
+  /**
+   * write the log to the log file up to the given offset, without
+   * waiting for the disk, so that what was logged can be read back.
+   * @return error code. 0 if no error
+   */
+  RC writeOut(off_t end);
+
+  /**
+   * read logged data back.
+   * @param offset[IN] the log offset to read from, as returned by append()
+   * @param buffer[OUT] the buffer to read into
+   * @param length[IN] # of bytes to read
+   * @return error code. 0 if no error
+   */
+  RC read(off_t offset, void* buffer, int length) const;
+
+  /**
+   * empty the log. every page logged must be in its file and synced.
+   * @return error code. 0 if no error
+   */
+  RC reset();
+
+  /**
+   * @return the size of the log, including the part not written yet
+   */
+  off_t size() const { return written + buffer.size(); }
+
+  /**
+   * @return the file descriptor of the log file
+   */
+  int getFd() const { return fd; }
+
+  long long getWriteCount() const { return writes; }  // # of write() calls
+  long long getSyncCount() const { return syncs; }    // # of fdatasync() calls
+  long long getCommitCount() const { return commits; } // # of commits
+
+ private:
+  int   fd;           // the log file. -1 if it is not open
+  off_t written;      // # of bytes in the log file. the buffer follows them
+  off_t synced;       // # of bytes of the log file known to be durable
+  off_t committed;    // the end of the last commit record
+  std::vector<char> buffer;  // the log records not written yet
+  std::map<std::string, int> files;  // the number of each file in the log
+
+  long long writes;
+  long long syncs;
+  long long commits;
+
+  /**
+   * append a record to the buffer, writing the buffer out first if the
+   * record does not fit.
+   * @return the log offset of the record payload. an error code (< 0)
+   *         if the log could not be written
+   */
+  off_t appendRecord(int type, int file, off_t offset, const void* data, int length);
+
+  /**
+   * apply the committed pages of the log to their files.
+   * @return error code. 0 if no error
+   */
+  RC recover();
+};
+
+#endif // WRITEAHEADLOG_H
@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ *
+ * @author Junghoo "John" Cho <cho AT cs.ucla.edu>
+ * @date 3/24/2008
+ */
+
+//
+// replace a record file under the zone map saved for it with another
+// record file, and check that a scan skipping the pages by their zones
+// still reads every record of the new file.
+//
+// usage: zonetest
+//
+
+#include "Bruinbase.h"
+#include "RecordFile.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+using std::string;
+
+static const char* OLD_FILE = "zonetest_old.tbl";
+static const char* NEW_FILE = "zonetest_new.tbl";
+
+// append the keys from .. to - 1 to a new record file
+static RC makeFile(const char* name, int from, int to)
+{
+  RecordFile rf;
+  RecordId rid;
+  RC rc;
+
+  unlink(name);
+  unlink((string(name) + ".zone").c_str());
+  if ((rc = rf.open(name, 'w')) < 0) return rc;
+  for (int key = from; key < to && rc == 0; key++) {
+    char value[32];
+    sprintf(value, "value of the record %d", key);
+    rc = rf.append(key, value, rid);
+  }
+  RC closed = rf.close();
+  return (rc < 0) ? rc : closed;
+}
+
+// copy the content of a file over another, which keeps its inode
+static bool copyFile(const char* from, const char* to)
+{
+  char buf[4096];
+  ssize_t n = 0;
+
+  int in = open(from, O_RDONLY);
+  int out = open(to, O_WRONLY|O_TRUNC);
+  bool ok = (in >= 0 && out >= 0);
+  while (ok && (n = read(in, buf, sizeof(buf))) > 0) ok = (write(out, buf, n) == n);
+  if (in >= 0) close(in);
+  if (out >= 0) close(out);
+  return ok && n == 0;
+}
+
+// @return # of records with a key larger than min, not reading the pages whose zone has none
+static int countAbove(const char* name, int min)
+{
+  RecordFile rf;
+  RecordCursor scan;
+  PageZone zone;
+  int key, length, count = 0;
+  const char* value;
+
+  if (rf.open(name, 'r') < 0) return -1;
+  rf.startScan(scan);
+  for (;;) {
+    while (rf.nextZone(scan, zone) && zone.maxKey <= min) rf.skipZone(scan);
+    if (rf.readForward(scan, key, value, length) < 0) break;
+    if (key > min) count++;
+  }
+  rf.endScan(scan);
+  rf.close();
+  return count;
+}
+
+int main()
+{
+  // the old file ends up with a zone map of small keys, and the new
+  // one has as many pages again of large keys
+  if (makeFile(OLD_FILE, 0, 100) < 0 || makeFile(NEW_FILE, 1001, 1401) < 0) {
+    fprintf(stderr, "cannot create the record files\n");
+    return 1;
+  }
+  int before = countAbove(NEW_FILE, 1000);
+  if (!copyFile(NEW_FILE, OLD_FILE)) {
+    fprintf(stderr, "cannot copy %s to %s\n", NEW_FILE, OLD_FILE);
+    return 1;
+  }
+  int after = countAbove(OLD_FILE, 1000);
+
+  const char* names[] = { OLD_FILE, NEW_FILE };
+  for (int i = 0; i < 2; i++) {
+    unlink(names[i]);
+    unlink((string(names[i]) + ".zone").c_str());
+    unlink((string(names[i]) + ".hot").c_str());
+  }
+
+  printf("400 keys above 1000: %d read from the new file, %d after it replaced the old one\n",
+         before, after);
+  return (before == 400 && after == 400) ? 0 : 1;
+}
@@ -10,14 +10,119 @@
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "PageFile.h"
+#include "IoQueue.h"
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
 using namespace std;
 
+static void usage(const char* prog)
+{
+  fprintf(stderr, "usage: %s [-a] [-b] [-c cache_pages] [-d] [-H] [-l log_file] [-L slotted|pax|dict] [-m] [-p page_size] [-r lru|2q|lru2] [-T trace_file] [-U] [-w]\n", prog);
+  fprintf(stderr, "  -a  reserve the disk space of growing files in chunks ahead of the writes\n");
+  fprintf(stderr, "  -b  read tables in SELECT through the buffer pool (the default)\n");
+  fprintf(stderr, "  -c  # of pages in the buffer pool (default %d)\n",
+          PageFile::DEFAULT_CACHE_COUNT);
+  fprintf(stderr, "  -d  bypass the kernel page cache with O_DIRECT. overrides -m\n");
+  fprintf(stderr, "  -H  back the buffer pool with 2MB huge pages if available\n");
+  fprintf(stderr, "  -l  log the writes of LOAD to the file, recovering from it first\n");
+  fprintf(stderr, "  -L  layout of the table pages LOAD writes (default slotted). pax keeps\n"
+          "      the keys of a page together, for conditions on the key alone. dict\n"
+          "      also keeps each distinct value of a page once, for repetitive values\n");
+  fprintf(stderr, "  -m  map tables in SELECT into memory instead of reading them through\n"
+          "      the buffer pool, which then has no part in their reads or statistics\n");
+  fprintf(stderr, "  -p  page size of newly created files, a power of two "
+          "from %d to %d (default %d)\n",
+          PageFile::PAGE_SIZE, PageFile::MAX_PAGE_SIZE, PageFile::PAGE_SIZE);
+  fprintf(stderr, "  -r  replacement policy of the buffer pool (default lru)\n");
+  fprintf(stderr, "  -T  record the page accesses in the file, to be replayed by tracesim\n");
+  fprintf(stderr, "  -U  read page batches with a thread pool instead of io_uring\n");
+  fprintf(stderr, "  -w  write pages back to the disk when they are evicted or their file is\n"
+          "      closed, instead of writing them through. a crash may lose the pages\n"
+          "      not written back yet, unless the writes are logged with -l\n");
+}
 
-int main()
+int main(int argc, char* argv[])
 {
+  int opt;
+  bool direct = false;  // true if -d was given
+
+  // process the startup options
+  while ((opt = getopt(argc, argv, "abc:dHl:L:mp:r:T:Uw")) != -1) {
+    switch (opt) {
+    case 'a':
+      PageFile::setPreallocate(true);
+      break;
+    case 'b':
+      SqlEngine::setReadMode('r');
+      break;
+    case 'c':
+      if (atoi(optarg) <= 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      if (PageFile::setCacheSize(atoi(optarg)) < 0) {
+        fprintf(stderr, "cannot allocate a buffer pool of %s pages\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      PageFile::setDirectIo(true);
+      direct = true;
+      break;
+    case 'H':
+      PageFile::setHugePages(true);
+      break;
+    case 'l':
+      if (PageFile::setLog(optarg) < 0) {
+        fprintf(stderr, "cannot open or recover the log %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'L':
+      if (RecordFile::setLayout(optarg) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'p':
+      if (PageFile::setDefaultPageSize(atoi(optarg)) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'r':
+      if (PageFile::setReplacePolicy(optarg) < 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'T':
+      if (PageFile::setTrace(optarg) < 0) {
+        fprintf(stderr, "cannot create the trace %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'm':
+      SqlEngine::setReadMode('m');
+      break;
+    case 'U':
+      IoQueue::disableRing();
+      break;
+    case 'w':
+      PageFile::setWriteBack(true);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // mapped tables would be cached by the kernel again
+  if (direct) SqlEngine::setReadMode('r');
 
 // 	key: 2342, value: Last Ride, The
 // rid pid: 0, rid sid: 1key: 2634, value: Matter of Life and Death, A
@@ -56,5 +161,11 @@ int main()
   // run the SQL engine taking user commands from standard input (console).
   SqlEngine::run(stdin);
 
+  // the end of the trace is still buffered
+  if (PageFile::setTrace("") < 0) {
+    fprintf(stderr, "cannot write the trace\n");
+    return 1;
+  }
+
   return 0;
 }